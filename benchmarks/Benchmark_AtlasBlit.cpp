@@ -0,0 +1,197 @@
+// Compares the legacy per-pixel glyph drawing (a switch over the atlas channels
+// and the glyph pixel mode for every pixel) with the row kernels used by Atlas::Bitmap::Draw.
+#include "BlitKernels.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	double MedianMilliseconds(int repetitions, const std::function<void()>& function)
+	{
+		std::vector<double> times;
+		for (int i = 0; i < repetitions; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			function();
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	enum class PixelMode { GRAY, LCD, BGRA };
+
+	// A glyph bitmap laid out like the ones rendered by FreeType
+	struct SyntheticGlyph
+	{
+		std::vector<uint8_t> data;
+		unsigned int width, height; // in pixels
+		int stride; // in bytes
+		PixelMode mode;
+
+		int Channels() const { return mode == PixelMode::GRAY ? 1 : mode == PixelMode::LCD ? 3 : 4; }
+		uint8_t ByteAt(int x, int y) const { return data[y * stride + x]; }
+
+		// Accessors used by the legacy drawing, one call per channel of every pixel
+		uint8_t ColorRed(int x, int y) const { return ByteAt(x * Channels() + (mode == PixelMode::BGRA ? 2 : 0), y); }
+		uint8_t ColorGreen(int x, int y) const { return ByteAt(x * Channels() + (mode == PixelMode::GRAY ? 0 : 1), y); }
+		uint8_t ColorBlue(int x, int y) const { return ByteAt(x * Channels() + (mode == PixelMode::LCD ? 2 : 0), y); }
+		uint8_t ColorAlpha(int x, int y) const
+		{
+			if (mode == PixelMode::BGRA)
+				return ByteAt(x * Channels() + 3, y);
+			if (mode == PixelMode::LCD)
+				return 255;
+			return ByteAt(x * Channels(), y);
+		}
+	};
+
+	struct Placement
+	{
+		int x, y;
+		const SyntheticGlyph* glyph;
+	};
+
+	void DrawLegacy(std::vector<uint8_t>& data, int atlasWidth, int atlasChannels, const Placement& placement)
+	{
+		const SyntheticGlyph& glyph = *placement.glyph;
+		for (unsigned int glyphY = 0; glyphY < glyph.height; ++glyphY)
+		{
+			unsigned int row = (placement.y + glyphY) * atlasWidth * atlasChannels;
+			for (unsigned int glyphX = 0; glyphX < glyph.width; ++glyphX)
+			{
+				unsigned int index = row + placement.x * atlasChannels + glyphX * atlasChannels;
+				switch (atlasChannels)
+				{
+				case 1:
+					data[index] = 255 - glyph.ByteAt(glyphX, glyphY);
+					break;
+				case 3:
+					data[index + 0] = glyph.ColorRed(glyphX, glyphY);
+					data[index + 1] = glyph.ColorGreen(glyphX, glyphY);
+					data[index + 2] = glyph.ColorBlue(glyphX, glyphY);
+					break;
+				case 4:
+				{
+					uint8_t r = glyph.ColorRed(glyphX, glyphY);
+					uint8_t g = glyph.ColorGreen(glyphX, glyphY);
+					uint8_t b = glyph.ColorBlue(glyphX, glyphY);
+					uint8_t a = glyph.ColorAlpha(glyphX, glyphY);
+					if (glyph.Channels() == 1)
+					{
+						r = 255 - r;
+						g = 255 - g;
+						b = 255 - b;
+					}
+					data[index + 0] = r;
+					data[index + 1] = g;
+					data[index + 2] = b;
+					data[index + 3] = a;
+					break;
+				}
+				default:
+					throw std::runtime_error("Unsupported number of channels");
+				}
+			}
+		}
+	}
+
+	void DrawWithKernels(std::vector<uint8_t>& data, int atlasWidth, int atlasChannels, const Placement& placement)
+	{
+		const SyntheticGlyph& glyph = *placement.glyph;
+		const size_t stride = static_cast<size_t>(atlasWidth) * atlasChannels;
+		uint8_t* destination = data.data() + placement.y * stride + static_cast<size_t>(placement.x) * atlasChannels;
+		if (atlasChannels == 1)
+			Trex::BlitRows<Trex::BlitRowGrayInverted>(glyph.data.data(), glyph.stride, destination, stride, glyph.width, glyph.height);
+		else if (atlasChannels == 3)
+			Trex::BlitRows<Trex::BlitRowRGB>(glyph.data.data(), glyph.stride, destination, stride, glyph.width, glyph.height);
+		else if (glyph.mode == PixelMode::BGRA)
+			Trex::BlitRows<Trex::BlitRowBGRAToRGBA>(glyph.data.data(), glyph.stride, destination, stride, glyph.width, glyph.height);
+		else
+			Trex::BlitRows<Trex::BlitRowGrayToRGBA>(glyph.data.data(), glyph.stride, destination, stride, glyph.width, glyph.height);
+	}
+
+	// Glyph sizes similar to a CJK font rendered at 32 pixels
+	std::vector<SyntheticGlyph> GetSyntheticGlyphs(size_t count, PixelMode mode)
+	{
+		std::mt19937 generator(42);
+		std::uniform_int_distribution<unsigned int> width(18, 34);
+		std::uniform_int_distribution<unsigned int> height(16, 36);
+		std::uniform_int_distribution<int> byte(0, 255);
+		std::vector<SyntheticGlyph> glyphs(count);
+		for (auto& glyph : glyphs)
+		{
+			glyph.mode = mode;
+			glyph.width = width(generator);
+			glyph.height = height(generator);
+			// FreeType rows are padded to 4 bytes
+			glyph.stride = static_cast<int>((glyph.width * glyph.Channels() + 3) / 4 * 4);
+			glyph.data.resize(static_cast<size_t>(glyph.stride) * glyph.height);
+			for (auto& value : glyph.data)
+				value = static_cast<uint8_t>(byte(generator));
+		}
+		return glyphs;
+	}
+
+	// Place the glyphs in rows of a square atlas, like the shelf packer does
+	std::vector<Placement> PlaceGlyphs(const std::vector<SyntheticGlyph>& glyphs, int atlasSize)
+	{
+		std::vector<Placement> placements;
+		int x = 0, y = 0, rowHeight = 0;
+		for (const auto& glyph : glyphs)
+		{
+			if (x + static_cast<int>(glyph.width) > atlasSize)
+			{
+				x = 0;
+				y += rowHeight;
+				rowHeight = 0;
+			}
+			if (y + static_cast<int>(glyph.height) > atlasSize)
+				break;
+			placements.push_back({ x, y, &glyph });
+			x += glyph.width;
+			rowHeight = std::max(rowHeight, static_cast<int>(glyph.height));
+		}
+		return placements;
+	}
+
+	void Compare(const char* name, PixelMode mode, int atlasChannels)
+	{
+		constexpr int atlasSize = 4096;
+		constexpr int repetitions = 5;
+		const auto glyphs = GetSyntheticGlyphs(30'000, mode);
+		const auto placements = PlaceGlyphs(glyphs, atlasSize);
+
+		std::vector<uint8_t> legacyData(static_cast<size_t>(atlasSize) * atlasSize * atlasChannels);
+		std::vector<uint8_t> kernelData(legacyData.size());
+		const double legacy = MedianMilliseconds(repetitions, [&] {
+			for (const auto& placement : placements)
+				DrawLegacy(legacyData, atlasSize, atlasChannels, placement);
+		});
+		const double kernels = MedianMilliseconds(repetitions, [&] {
+			for (const auto& placement : placements)
+				DrawWithKernels(kernelData, atlasSize, atlasChannels, placement);
+		});
+		if (legacyData != kernelData)
+			throw std::runtime_error("Row kernels produced a different bitmap");
+
+		std::printf("%-14s %6zu glyphs into %dx%d | per pixel: %8.2f ms | row kernels: %7.2f ms | speedup: %.2fx\n",
+			name, placements.size(), atlasSize, atlasSize, legacy, kernels, legacy / kernels);
+	}
+}
+
+int main()
+{
+	Compare("gray -> gray", PixelMode::GRAY, 1);
+	Compare("LCD -> RGB", PixelMode::LCD, 3);
+	Compare("BGRA -> RGBA", PixelMode::BGRA, 4);
+	Compare("gray -> RGBA", PixelMode::GRAY, 4);
+	return 0;
+}
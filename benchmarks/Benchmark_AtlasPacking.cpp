@@ -0,0 +1,100 @@
+// Compares the legacy atlas sizing (doubling square trials followed by
+// a final placement pass) with the single-pass PackAtlas.
+#include "Trex/Atlas.hpp"
+#include "Packer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace
+{
+	double MedianMilliseconds(int repetitions, const std::function<void()>& function)
+	{
+		std::vector<double> times;
+		for (int i = 0; i < repetitions; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			function();
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	// The algorithm used before PackAtlas: double the square atlas until all rectangles fit,
+	// then walk the placement once more to get the final positions.
+	Trex::PackerResult PackWithDoublingTrials(Trex::PackingMethod method, const std::vector<Trex::PackerRect>& rects)
+	{
+		unsigned int atlasSize = 128;
+		while (not Trex::PackAll(method, rects, atlasSize, atlasSize).has_value())
+		{
+			atlasSize *= 2;
+		}
+		return *Trex::PackAll(method, rects, atlasSize, atlasSize);
+	}
+
+	std::vector<Trex::PackerRect> GetFontRects(const char* fontPath, int fontSize, int padding)
+	{
+		Trex::Atlas atlas(fontPath, fontSize, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, padding);
+		std::vector<Trex::PackerRect> rects;
+		for (const Trex::Glyph& glyph : atlas.GetGlyphs().Data())
+		{
+			rects.push_back({ glyph.width + padding * 2, glyph.height + padding * 2 });
+		}
+		return rects;
+	}
+
+	// Glyph sizes similar to a CJK font rendered at 32 pixels
+	std::vector<Trex::PackerRect> GetSyntheticRects(size_t count)
+	{
+		std::mt19937 generator(42);
+		std::uniform_int_distribution<unsigned int> width(18, 34);
+		std::uniform_int_distribution<unsigned int> height(16, 36);
+		std::vector<Trex::PackerRect> rects(count);
+		for (auto& rect : rects)
+		{
+			rect = { width(generator), height(generator) };
+		}
+		return rects;
+	}
+
+	const char* GetMethodName(Trex::PackingMethod method)
+	{
+		switch (method)
+		{
+		case Trex::PackingMethod::SHELF: return "shelf";
+		case Trex::PackingMethod::SKYLINE: return "skyline";
+		default: return "min-waste";
+		}
+	}
+
+	void Compare(const char* name, const std::vector<Trex::PackerRect>& rects, Trex::PackingMethod method)
+	{
+		constexpr int repetitions = 5;
+		const double legacy = MedianMilliseconds(repetitions, [&] { PackWithDoublingTrials(method, rects); });
+		const double singlePass = MedianMilliseconds(repetitions, [&] {
+			Trex::PackAtlas(method, rects, Trex::SizeConstraint::POWER_OF_TWO_SQUARE);
+		});
+
+		std::printf("%-28s %-8s %8zu rects | doubling trials: %9.2f ms | single pass: %9.2f ms | speedup: %.2fx\n",
+			name, GetMethodName(method), rects.size(), legacy, singlePass, legacy / singlePass);
+	}
+}
+
+int main()
+{
+	const auto robotoRects = GetFontRects("fonts/Roboto-Regular.ttf", 32, 1);
+	const auto syntheticRects = GetSyntheticRects(50'000);
+
+	for (auto method : { Trex::PackingMethod::SHELF, Trex::PackingMethod::SKYLINE, Trex::PackingMethod::SKYLINE_MIN_WASTE })
+	{
+		Compare("Roboto-Regular 32px", robotoRects, method);
+		Compare("Synthetic CJK-like glyphs", syntheticRects, method);
+	}
+
+	return 0;
+}
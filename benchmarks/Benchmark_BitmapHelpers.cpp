@@ -0,0 +1,100 @@
+// Compares the legacy byte-by-byte bitmap conversions, which allocate a new vector on
+// every call, with the vectorized conversions writing into a caller-provided buffer.
+#include "Trex/BitmapHelpers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	double MedianMilliseconds(int repetitions, const std::function<void()>& function)
+	{
+		std::vector<double> times;
+		for (int i = 0; i < repetitions; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			function();
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	// The conversions used before the output span overloads
+	std::vector<uint8_t> LegacyConvertToGrayAlpha(std::span<const uint8_t> input)
+	{
+		std::vector<uint8_t> output(input.size() * 2);
+		for (size_t i = 0; i < input.size(); i++)
+		{
+			output[i * 2] = input[i];
+			output[i * 2 + 1] = 255;
+		}
+		return output;
+	}
+
+	std::vector<uint8_t> LegacyConvertToRGB(std::span<const uint8_t> input)
+	{
+		std::vector<uint8_t> output(input.size() * 3);
+		for (size_t i = 0; i < input.size(); i++)
+		{
+			output[i * 3] = input[i];
+			output[i * 3 + 1] = input[i];
+			output[i * 3 + 2] = input[i];
+		}
+		return output;
+	}
+
+	std::vector<uint8_t> LegacyConvertToRGBA(std::span<const uint8_t> input)
+	{
+		std::vector<uint8_t> output(input.size() * 4);
+		for (size_t i = 0; i < input.size(); i++)
+		{
+			output[i * 4] = input[i];
+			output[i * 4 + 1] = input[i];
+			output[i * 4 + 2] = input[i];
+			output[i * 4 + 3] = 255;
+		}
+		return output;
+	}
+
+	using LegacyConversion = std::vector<uint8_t> (*)(std::span<const uint8_t>);
+	using SpanConversion = void (*)(std::span<const uint8_t>, std::span<uint8_t>);
+
+	void Compare(const char* name, const std::vector<uint8_t>& bitmap, size_t channels, LegacyConversion legacyConversion, SpanConversion spanConversion)
+	{
+		constexpr int repetitions = 9;
+		std::vector<uint8_t> legacyOutput;
+		std::vector<uint8_t> output(bitmap.size() * channels); // Stands for a reused staging buffer
+
+		const double legacy = MedianMilliseconds(repetitions, [&] { legacyOutput = legacyConversion(bitmap); });
+		const double span = MedianMilliseconds(repetitions, [&] { spanConversion(bitmap, output); });
+		if (legacyOutput != output)
+			throw std::runtime_error("Vectorized conversion produced a different bitmap");
+
+		std::printf("%-10s %zu MB | legacy loop + allocation: %7.2f ms | into span: %6.2f ms | speedup: %.2fx\n",
+			name, output.size() >> 20, legacy, span, legacy / span);
+	}
+}
+
+int main()
+{
+	// A large grayscale atlas
+	constexpr size_t atlasSize = 4096;
+	std::vector<uint8_t> bitmap(atlasSize * atlasSize);
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<int> byte(0, 255);
+	for (auto& value : bitmap)
+		value = static_cast<uint8_t>(byte(generator));
+
+	Compare("GrayAlpha", bitmap, 2, LegacyConvertToGrayAlpha, Trex::ConvertBitmapToGrayAlpha);
+	Compare("RGB", bitmap, 3, LegacyConvertToRGB, Trex::ConvertBitmapToRGB);
+	Compare("RGBA", bitmap, 4, LegacyConvertToRGBA, Trex::ConvertBitmapToRGBA);
+	return 0;
+}
@@ -0,0 +1,193 @@
+// Compares shaping paragraphs of a chat log without a cache, with the whole-text cache
+// and with the word cache of TextShaper. Every paragraph is unique, but all of them are
+// built from a small vocabulary, so only the word cache can reuse earlier results.
+// Then counts heap allocations of shaping UI labels every frame into new and reused vectors,
+// and compares the ShapedGlyph vector with the ShapedText arrays for large cached texts.
+#include "Trex/TextShaper.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	std::atomic<size_t> allocationCount = 0;
+}
+
+void* operator new(std::size_t size)
+{
+	++allocationCount;
+	if (void* pointer = std::malloc(size == 0 ? 1 : size))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+namespace
+{
+	double MedianMilliseconds(int repetitions, const std::function<void()>& function)
+	{
+		std::vector<double> times;
+		for (int i = 0; i < repetitions; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			function();
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	std::vector<std::string> GenerateParagraphs(size_t count, size_t wordsPerParagraph)
+	{
+		const std::vector<std::string> vocabulary = {
+			"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "and", "then",
+			"runs", "away", "from", "hunter", "who", "never", "sees", "it", "again", "today",
+			"message", "server", "player", "joined", "left", "game", "round", "won", "lost", "team"
+		};
+		std::mt19937 generator(42);
+		std::uniform_int_distribution<size_t> word(0, vocabulary.size() - 1);
+
+		std::vector<std::string> paragraphs(count);
+		for (auto& paragraph : paragraphs)
+		{
+			for (size_t i = 0; i < wordsPerParagraph; ++i)
+			{
+				paragraph += (i == 0 ? "" : " ") + vocabulary[word(generator)];
+			}
+		}
+		return paragraphs;
+	}
+
+	double ShapeAll(Trex::TextShaper& shaper, const std::vector<std::string>& paragraphs)
+	{
+		size_t glyphCount = 0;
+		const double time = MedianMilliseconds(5, [&] {
+			for (const auto& paragraph : paragraphs)
+			{
+				glyphCount += shaper.ShapeUtf8Shared(paragraph)->size();
+			}
+		});
+		if (glyphCount == 0)
+			std::printf("No glyphs were shaped\n");
+		return time;
+	}
+
+	struct FrameResult
+	{
+		double milliseconds;
+		size_t allocations; // Calls of operator new in one frame. HarfBuzz allocates with malloc.
+	};
+
+	FrameResult ShapeFrame(const std::function<void()>& shapeLabels)
+	{
+		shapeLabels(); // Warm up buffers and caches
+		const size_t allocationsBefore = allocationCount;
+		shapeLabels();
+		const size_t allocations = allocationCount - allocationsBefore;
+		return { MedianMilliseconds(9, shapeLabels), allocations };
+	}
+
+	void CompareLabels(const Trex::Atlas& atlas)
+	{
+		const std::vector<std::string> labels = GenerateParagraphs(200, 3);
+		std::vector<std::u32string> labels32;
+		for (const auto& label : labels)
+			labels32.emplace_back(label.begin(), label.end());
+
+		Trex::TextShaper shaper(atlas);
+		Trex::ShapedGlyphs output;
+		const FrameResult returned = ShapeFrame([&] {
+			for (const auto& label : labels32)
+				output = shaper.ShapeUtf32(label);
+		});
+		const FrameResult reused = ShapeFrame([&] {
+			for (const auto& label : labels32)
+			{
+				output.clear();
+				shaper.ShapeUtf32(label, output);
+			}
+		});
+		shaper.SetCacheCapacity(labels.size());
+		const FrameResult cached = ShapeFrame([&] {
+			for (const auto& label : labels32)
+			{
+				output.clear();
+				shaper.ShapeUtf32(label, output);
+			}
+		});
+
+		std::printf("%zu UTF-32 labels per frame | returned vectors: %6.3f ms, %zu allocations | reused output: %6.3f ms, %zu allocations | reused output + text cache: %6.3f ms, %zu allocations\n",
+			labels.size(), returned.milliseconds, returned.allocations, reused.milliseconds, reused.allocations, cached.milliseconds, cached.allocations);
+	}
+
+	void CompareLayouts(const Trex::Atlas& atlas, const std::vector<std::string>& paragraphs)
+	{
+		Trex::TextShaper shaper(atlas);
+		shaper.SetCacheCapacity(paragraphs.size());
+		Trex::ShapedGlyphs glyphs;
+		Trex::ShapedText text;
+		float width = 0.0f;
+
+		const double vector = MedianMilliseconds(9, [&] {
+			glyphs.clear();
+			for (const auto& paragraph : paragraphs)
+				shaper.ShapeUtf8(paragraph, glyphs);
+			width += Trex::TextShaper::Measure(glyphs).width;
+		});
+		const double arrays = MedianMilliseconds(9, [&] {
+			text.Clear();
+			for (const auto& paragraph : paragraphs)
+				shaper.ShapeUtf8(paragraph, text);
+			width += shaper.Measure(text).width;
+		});
+		if (glyphs.size() != text.Size() || width <= 0.0f)
+			std::printf("Layouts differ\n");
+
+		const size_t arrayBytes = sizeof(uint32_t) + 4 * sizeof(float);
+		std::printf("%zu cached glyphs, shape + measure | ShapedGlyphs (%zu B/glyph): %6.2f ms | ShapedText (%zu B/glyph): %6.2f ms | speedup: %.2fx\n",
+			glyphs.size(), sizeof(Trex::ShapedGlyph), vector, arrayBytes, arrays, vector / arrays);
+	}
+}
+
+int main()
+{
+	const Trex::Atlas atlas("fonts/Roboto-Regular.ttf", 32, Trex::Charset::Ascii());
+	const std::vector<std::string> paragraphs = GenerateParagraphs(1000, 40);
+
+	Trex::TextShaper uncached(atlas);
+	const double none = ShapeAll(uncached, paragraphs);
+
+	Trex::TextShaper textCache(atlas);
+	textCache.SetCacheCapacity(256, Trex::ShapeCacheMode::TEXT);
+	const double text = ShapeAll(textCache, paragraphs);
+
+	Trex::TextShaper wordCache(atlas);
+	wordCache.SetCacheCapacity(256, Trex::ShapeCacheMode::WORDS);
+	const double words = ShapeAll(wordCache, paragraphs);
+	const Trex::ShapeCacheStats stats = wordCache.GetCacheStats();
+
+	std::printf("%zu unique paragraphs | no cache: %7.2f ms | text cache: %7.2f ms | word cache: %7.2f ms | speedup: %.2fx\n",
+		paragraphs.size(), none, text, words, none / words);
+	std::printf("Word cache: %zu hits, %zu misses, %zu words\n", stats.hits, stats.misses, stats.size);
+
+	CompareLabels(atlas);
+	CompareLayouts(atlas, paragraphs);
+	return 0;
+}
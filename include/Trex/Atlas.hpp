@@ -2,9 +2,15 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <optional>
+#include <utility>
 #include <string>
 #include <span>
+#include <ranges>
+#include <limits>
 #include "Font.hpp"
+#include "FontStack.hpp"
 #include "Charset.hpp"
 
 
@@ -17,45 +23,137 @@ namespace Trex
 		int x, y; // Top left corner of the glyph in the atlas
 		unsigned int width, height;
 		int bearingX, bearingY; 
+		unsigned int page = 0; // Index of the bitmap page containing the glyph
+
+		bool operator==(const Glyph&) const = default;
 	};
 
 	enum class RenderMode { DEFAULT, COLOR, SDF, LCD };
 
+	enum class PackingMethod { SHELF, SKYLINE, SKYLINE_MIN_WASTE };
+	enum class SizeConstraint { POWER_OF_TWO_SQUARE, POWER_OF_TWO, NONE };
+	enum class AtlasMode { STATIC, DYNAMIC, CACHE };
+
+	struct AtlasOptions
+	{
+		unsigned int threads = 1; // Number of threads rasterizing glyphs. 0 means all hardware threads.
+		PackingMethod packing = PackingMethod::SHELF;
+		SizeConstraint size = SizeConstraint::POWER_OF_TWO_SQUARE;
+		AtlasMode atlasMode = AtlasMode::STATIC;
+		unsigned int width = 0; // Width of a dynamic or cache atlas. 0 means it is chosen for the initial charset.
+		unsigned int height = 0; // Height of a cache atlas. 0 means it is the same as the width.
+		unsigned int maxPageSize = 0; // Maximum width and height of a bitmap page. 0 means unlimited.
+		bool deduplicateBitmaps = false; // Glyphs with identical bitmaps share one place in the atlas
+		bool streamingBuild = false; // Measure and pack all glyphs first, then render each one straight into the atlas
+	};
+
+	// Rectangle of the atlas bitmap (in pixels)
+	struct AtlasRegion
+	{
+		int x, y;
+		unsigned int width, height;
+		unsigned int page = 0;
+
+		bool operator==(const AtlasRegion&) const = default;
+	};
+
+	class RectPacker;
+	struct PackerRect;
+	struct PackerPosition;
+	struct AtlasLayout;
+
 	class Atlas
 	{
 	public:
-		Atlas(const std::string& fontPath, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1);
-		Atlas(std::span<const uint8_t> fontData, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1);
+		Atlas(const std::string& fontPath, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+		Atlas(std::span<const uint8_t> fontData, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+		// The atlas sets the size of the font, so every atlas needs its own Font (see FontRegistry).
+		Atlas(std::shared_ptr<Font> font, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+		// Every codepoint is taken from the first font of the stack that has it. All fonts share the bitmap pages.
+		Atlas(FontStack fonts, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
 
 		class FreeTypeGlyph;
 		class Bitmap;
 		class Glyphs;
 
-		const Bitmap& GetBitmap() const { return m_Bitmap; }
-		const Glyphs& GetGlyphs() const { return m_Glyphs; }
+		const Bitmap& GetBitmap(unsigned int page = 0) const { return m_Bitmaps.at(page); }
+		const std::vector<Bitmap>& GetBitmaps() const { return m_Bitmaps; }
+		// References into the table stay valid when more glyphs are loaded, unless the table is shared
+		// (see GetSharedGlyphs). Then they are valid only until the next glyph is added or evicted.
+		const Glyphs& GetGlyphs() const { return *m_Glyphs; }
+		// The glyph table is shared, not copied. Changes of the atlas never modify a table shared with others.
+		std::shared_ptr<const Glyphs> GetSharedGlyphs() const { return m_Glyphs; }
 
-		std::shared_ptr<const Font> GetFont() const { return m_Font; }
-		void SaveToFile(const std::string& path) const;
+		// The primary font of the font stack
+		std::shared_ptr<const Font> GetFont() const { return m_Fonts->GetPrimaryFont(); }
+		std::shared_ptr<const FontStack> GetFontStack() const { return m_Fonts; }
+		void SaveToFile(const std::string& path, unsigned int page = 0) const;
+
+		// Write the atlas to a binary cache file. Only a static atlas can be cached.
+		void SaveCache(const std::string& path) const;
+		// Load the atlas from a cache file written by SaveCache without rasterizing any glyph.
+		// When the file is missing or it was built from different inputs, the atlas is built and the cache is written again.
+		static Atlas LoadOrBuild(const std::string& cachePath, const std::string& fontPath, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+		static Atlas LoadOrBuild(const std::string& cachePath, std::span<const uint8_t> fontData, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+		static Atlas LoadOrBuild(const std::string& cachePath, std::shared_ptr<Font> font, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+		static Atlas LoadOrBuild(const std::string& cachePath, FontStack fonts, int fontSize, const Charset& = Charset::Full(), RenderMode = RenderMode::DEFAULT, int padding = 1, const AtlasOptions& = {});
+
+		bool IsDynamic() const { return m_Options.atlasMode != AtlasMode::STATIC; }
+		bool IsCache() const { return m_Options.atlasMode == AtlasMode::CACHE; }
+		// In a dynamic atlas, missing glyphs are rasterized and added on first use.
+		// A cache atlas has a fixed size and evicts the least recently used glyphs to make space.
+		// Glyphs are returned by value. A later load may evict a returned glyph from a cache atlas and give
+		// its region to another glyph, even within one shaped text. Such regions are in TakeDirtyRegions.
+		Glyph LoadGlyphByIndex(uint32_t glyphIndex);
+		Glyph LoadGlyphByCodepoint(uint32_t codepoint);
+		// Regions of the bitmap changed since the last call.
+		std::vector<AtlasRegion> TakeDirtyRegions();
+		// Glyph used for glyphs missing from the atlas. Does nothing when the codepoint has no glyph in the atlas.
+		// Tables already shared with text shapers or copies of the atlas keep their unknown glyph.
+		void SetUnknownGlyph(uint32_t codepoint);
 
 		class Glyphs
 		{
 		public:
-			Glyphs( const std::shared_ptr<const Font> font)
-				: m_Font(font) {}
-			const std::map<uint32_t, Glyph>& Data() const { return m_Glyphs; }
-			bool Empty() const { return m_Glyphs.empty(); }
-
-			void SetUnknownGlyph( uint32_t codepoint ) const;
-			void SetUnknownGlyphIndex( uint32_t index ) const;
-			const Glyph& GetUnknownGlyph() const;
+			Glyphs( std::shared_ptr<const FontStack> fonts )
+				: m_Fonts( std::move( fonts ) ) {}
+			// Glyphs in the atlas ordered by glyph index
+			auto Data() const { return m_Table | std::views::filter( IsPresent ); }
+			size_t Size() const { return m_Size; }
+			bool Empty() const { return m_Size == 0; }
+			bool Contains( uint32_t index ) const { return index < m_Table.size() && m_Table[index].glyphIndex == index; }
+
+			const Glyph& GetUnknownGlyph() const { return m_Table[m_UnknownGlyphIndex]; }
 			const Glyph& GetGlyphByCodepoint( uint32_t codepoint ) const;
-			const Glyph& GetGlyphByIndex( uint32_t index ) const;
-			void Add(int bitmapX, int bitmapY, const FreeTypeGlyph&);
+			const Glyph& GetGlyphByIndex( uint32_t index ) const { return Contains( index ) ? m_Table[index] : GetUnknownGlyph(); }
+			void Add(int bitmapX, int bitmapY, const FreeTypeGlyph&, unsigned int page = 0);
+			void Add(const Glyph& glyph);
+			void Remove(uint32_t index);
+			// Make space for all glyph indices below glyphCount, so adding glyphs never moves this table.
+			// An atlas still replaces a table shared with others when it adds or evicts a glyph.
+			void Reserve(uint32_t glyphCount);
+
+			// Glyph index of a codepoint in the font stack. Mapped codepoints are found without asking FreeType.
+			uint32_t GetGlyphIndex( uint32_t codepoint ) const;
+			void MapCodepoint( uint32_t codepoint, uint32_t glyphIndex );
 		private:
+			friend class Atlas; // Only the atlas changes the unknown glyph and reads the tables of a cache file
+
+			void SetUnknownGlyph( uint32_t codepoint );
+			void SetUnknownGlyphIndex( uint32_t index );
 
-			std::map<uint32_t, Glyph> m_Glyphs {};
-			std::shared_ptr<const Font> m_Font {};
-			mutable uint32_t m_UnknownGlyphIndex = 0;
+			static constexpr uint32_t MissingGlyphIndex = std::numeric_limits<uint32_t>::max();
+			static bool IsPresent( const Glyph& glyph ) { return glyph.glyphIndex != MissingGlyphIndex; }
+
+			// Indexed directly by glyph index. Glyphs missing from the atlas have MissingGlyphIndex.
+			std::vector<Glyph> m_Table {};
+			size_t m_Size = 0;
+			// Two-level page table from codepoints to glyph indices. A page holds the offset of a block of
+			// 256 consecutive codepoints in m_CodepointBlocks. Block 0 has no mapped codepoints.
+			std::vector<uint32_t> m_CodepointPages {};
+			std::vector<uint32_t> m_CodepointBlocks {};
+			std::shared_ptr<const FontStack> m_Fonts {};
+			uint32_t m_UnknownGlyphIndex = 0;
 		};
 
 		class Bitmap
@@ -63,6 +161,7 @@ namespace Trex
 		public:
 			Bitmap() = default;
 			Bitmap(unsigned int width, unsigned int height, unsigned int channels);
+			Bitmap(unsigned int width, unsigned int height, unsigned int channels, std::span<const uint8_t> data);
 
 			const std::vector<uint8_t>& Data() const { return m_Data; }
 			unsigned int Width() const { return m_Width; }
@@ -70,6 +169,8 @@ namespace Trex
 			unsigned int Channels() const { return m_Channels; }
 
 			void Draw(int x, int y, const FreeTypeGlyph&);
+			void Grow(unsigned int height);
+			void Clear(AtlasRegion);
 		private:
 			std::vector<uint8_t> m_Data {};
 			unsigned int m_Width {};
@@ -78,11 +179,40 @@ namespace Trex
 		};
 
 	private:
-		void InitializeAtlas(const Charset&, RenderMode, int padding);
+		struct DeferInitialization {}; // The glyphs are loaded from a cache or built later
+		Atlas(DeferInitialization, FontStack fonts, int fontSize, const Charset&, RenderMode, int padding, const AtlasOptions&);
+		static Atlas LoadOrBuild(const std::string& cachePath, Atlas&& atlas, const Charset&);
+		bool LoadCache(std::span<const uint8_t> data);
+		uint64_t GetCacheKey() const;
+
+		void InitializeAtlas(const Charset&);
+		AtlasLayout PackGlyphs(const std::vector<PackerRect>& rects);
 		void InitializeDefaultGlyphIndex();
+		std::shared_ptr<RectPacker> CreatePagePacker(unsigned int width) const;
+		std::optional<std::pair<unsigned int, PackerPosition>> InsertIntoPages(PackerRect);
+		void GrowPage(unsigned int page);
+		void AddGlyph(uint32_t codepoint, uint32_t glyphIndex);
+		Glyphs& MutableGlyphs();
+		void TouchGlyph(uint32_t glyphIndex);
+		bool CanFitAfterEviction(PackerRect) const;
+		bool EvictLeastRecentlyUsedGlyph();
+		void MarkDirty(AtlasRegion);
+
+		std::shared_ptr<const FontStack> m_Fonts;
+		std::vector<Bitmap> m_Bitmaps;
+		std::shared_ptr<Glyphs> m_Glyphs; // Shared with text shapers and copies of this atlas. Copied on write.
+		RenderMode m_RenderMode;
+		int m_Padding;
+		AtlasOptions m_Options;
+
+		std::vector<std::shared_ptr<RectPacker>> m_Packers; // Free space of every page of a dynamic atlas. Copied on write.
+		std::vector<AtlasRegion> m_DirtyRegions;
+
+		// Last use of every glyph that can be evicted from a cache atlas.
+		// Glyphs of the initial charset are never evicted.
+		std::unordered_map<uint32_t, uint64_t> m_GlyphLastUse;
+		uint64_t m_UseCounter = 0;
 
-		std::shared_ptr<Font> m_Font;
-		Bitmap m_Bitmap;
-		Glyphs m_Glyphs;
+		uint64_t m_BuildInputsHash; // Hash of all inputs of the atlas except the font data
 	};
 }
\ No newline at end of file
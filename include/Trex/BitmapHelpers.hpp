@@ -9,15 +9,22 @@
 //
 // All conversion functions keep the grayscale value of the pixels.
 // Ondly the format of the bitmap is changed.
+//
+// The overloads with an output span write into a buffer provided by the caller
+// (e.g. a mapped GPU staging buffer) and do not allocate.
+// The output must be large enough for the converted bitmap.
 
 namespace Trex
 {
 	// Convert 1-byte: GRAY8 to 2-byte: GRAYALPHA88
 	std::vector<uint8_t> ConvertBitmapToGrayAlpha(std::span<const uint8_t> input);
+	void ConvertBitmapToGrayAlpha(std::span<const uint8_t> input, std::span<uint8_t> output);
 
 	// Convert 1-byte: GRAY8 to 3-byte: RGB888
 	std::vector<uint8_t> ConvertBitmapToRGB(std::span<const uint8_t> input);
+	void ConvertBitmapToRGB(std::span<const uint8_t> input, std::span<uint8_t> output);
 
 	// Convert 1-byte: GRAY8 to 4-byte: RGBA8888
 	std::vector<uint8_t> ConvertBitmapToRGBA(std::span<const uint8_t> input);
+	void ConvertBitmapToRGBA(std::span<const uint8_t> input, std::span<uint8_t> output);
 }
\ No newline at end of file
@@ -1,9 +1,12 @@
 #pragma once
+#include <algorithm>
+#include <ranges>
 #include <utility>
-#include <set>
 #include <vector>
 #include <span>
 #include <cstdint>
+#include <cstddef>
+#include <iterator>
 
 
 namespace Trex
@@ -30,16 +33,89 @@ namespace Trex
 		}
 		static Charset Ascii() { return Charset( 0, 127 ); };
 
-		void AddCodepoint(const uint32_t codepoint) { m_Charset.insert(codepoint); }
-		size_t Size() const { return m_Charset.size(); }
-		const std::set<uint32_t> Codepoints() const { return m_Charset; }
+		void AddCodepoint(uint32_t codepoint);
+		size_t Size() const { return m_Size; }
+		// Sorted ranges of codepoints. Ranges never overlap or touch each other.
+		std::span<const Range> Ranges() const { return m_Ranges; }
+		bool Contains(uint32_t codepoint) const;
 		bool IsFull() const { return m_AllCodepoints; }
 
-		auto begin() const { return m_Charset.begin(); }
-		auto end() const { return m_Charset.end(); }
+		// Set algebra. The full charset contains every codepoint, so it cannot be subtracted from.
+		Charset Union(const Charset& other) const;
+		Charset Intersection(const Charset& other) const;
+		Charset Difference(const Charset& other) const;
+
+		bool operator==(const Charset&) const = default;
+
+		// Iterates over all codepoints of the ranges without copying them
+		class Iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = uint32_t;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const uint32_t*;
+			using reference = uint32_t;
+
+			Iterator() = default;
+			Iterator(const Range* range, const Range* end)
+				: m_Range(range), m_End(end), m_Codepoint(range != end ? range->first : 0) {}
+
+			uint32_t operator*() const { return m_Codepoint; }
+			Iterator& operator++()
+			{
+				if (m_Codepoint == m_Range->second)
+				{
+					++m_Range;
+					m_Codepoint = m_Range != m_End ? m_Range->first : 0;
+				}
+				else
+				{
+					++m_Codepoint;
+				}
+				return *this;
+			}
+			Iterator operator++(int)
+			{
+				Iterator previous = *this;
+				++*this;
+				return previous;
+			}
+			bool operator==(const Iterator& other) const { return m_Range == other.m_Range && m_Codepoint == other.m_Codepoint; }
+
+		private:
+			const Range* m_Range = nullptr;
+			const Range* m_End = nullptr;
+			uint32_t m_Codepoint = 0;
+		};
+
+		Iterator begin() const { return { m_Ranges.data(), m_Ranges.data() + m_Ranges.size() }; }
+		Iterator end() const { return { m_Ranges.data() + m_Ranges.size(), m_Ranges.data() + m_Ranges.size() }; }
+
+		// Lazy view over all codepoints of the ranges. Compares equal to any range with the same codepoints.
+		class CodepointView
+		{
+		public:
+			explicit CodepointView(const Charset& charset) : m_Charset(&charset) {}
+
+			Iterator begin() const { return m_Charset->begin(); }
+			Iterator end() const { return m_Charset->end(); }
+			size_t size() const { return m_Charset->Size(); }
+
+			template <std::ranges::input_range R>
+			friend bool operator==(const CodepointView& view, const R& range) { return std::ranges::equal(view, range); }
+
+		private:
+			const Charset* m_Charset;
+		};
+
+		CodepointView Codepoints() const { return CodepointView(*this); }
 
 	private:
-		std::set<uint32_t> m_Charset = {};
+		static Charset FromNormalizedRanges(std::vector<Range> ranges);
+
+		std::vector<Range> m_Ranges = {};
+		size_t m_Size = 0;
 		bool m_AllCodepoints = false;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "Charset.hpp"
+
+namespace Trex
+{
+	class Font;
+
+	// Collects the codepoints used by UTF-8 text, e.g. localization string tables,
+	// so an atlas contains only the glyphs that are really needed.
+	class CharsetBuilder
+	{
+	public:
+		// Number of threads scanning a large text. 0 means all hardware threads.
+		explicit CharsetBuilder(unsigned int threads = 1);
+
+		// Throws std::runtime_error when the text is not valid UTF-8.
+		void AddUtf8(std::span<const char> text);
+		// The file is memory-mapped, so it is never copied.
+		void AddUtf8File(const std::string& path);
+
+		// All codepoints found in the text
+		Charset Build() const;
+		// Codepoints found in the text that have a glyph in the font
+		Charset Build(const Font& font) const;
+
+	private:
+		unsigned int m_Threads;
+		std::vector<uint64_t> m_Codepoints; // One bit for every Unicode codepoint
+	};
+}
@@ -3,8 +3,13 @@
 #include <span>
 #include <vector>
 #include <variant>
+#include <memory>
+#include <mutex>
+#include <string>
 
 struct FT_FaceRec_;
+struct FT_LibraryRec_;
+struct FT_SizeRec_;
 
 namespace Trex
 {
@@ -19,26 +24,60 @@ namespace Trex
 		int height;    // Distance from baseline to the next line's baseline (ascender - descender + linegap)
 	};
 
+	// COPY: the font keeps its own copy of the data.
+	// BORROW: the caller keeps the data alive for as long as the font and all its clones exist.
+	enum class DataOwnership { COPY, BORROW };
+
+	struct FontFace;
+
+	// Threading model: every FreeType face is guarded by its own lock, which all fonts sharing the face use.
+	// Fonts can be used on any thread. Fonts sharing a face are serialized, so use clones for full parallelism.
+	// SetSize must not be called while the same Font object is used on another thread.
 	class Font
 	{
 	public:
-		explicit Font(const char* path);
-		explicit Font(std::span<const uint8_t> data);
+		// The file is memory-mapped read-only, so its pages are loaded lazily and shared between processes.
+		// faceIndex selects a face of a font collection (.ttc, .otc).
+		explicit Font(const char* path, long faceIndex = 0);
+		explicit Font(std::span<const uint8_t> data, DataOwnership ownership = DataOwnership::COPY, long faceIndex = 0);
 		Font(Font&&) noexcept;
 		~Font();
 
+		// Open the same font again with its own FreeType library. Font data is shared, not copied.
+		// The clone can be used on a different thread than the original font.
+		Font Clone() const;
+
+		// Each font has its own FT_Size, so fonts sharing a face (see FontRegistry) keep their own sizes.
 		void SetSize(const FontSize& size);
+		// Locks the face, which may be shared with other fonts, and activates this font's size.
+		// Hold the lock while using the face directly. It can be locked again on the same thread.
+		[[nodiscard]] std::unique_lock<std::recursive_mutex> LockFace() const;
 		uint32_t GetGlyphIndex(uint32_t codepoint) const;
 
 		FontMetrics GetMetrics() const;
 
+		// Hash of the font file bytes and the face index. It does not depend on the size.
+		// It is computed once and shared by all fonts of the same face (see FontRegistry).
+		uint64_t GetContentHash() const;
+
+		long GetFaceIndex() const;
+		// Number of faces in the font file. It is 1 unless the file is a font collection.
+		long GetFaceCount() const;
+		std::string GetFamilyName() const;
+		std::string GetStyleName() const;
+
 		FT_FaceRec_* face = nullptr;
 
 	private:
+		friend class FontRegistry;
+
+		explicit Font(std::shared_ptr<FontFace> sharedFace);
+		void CreateSize();
 		void SetSizeInPixels(Pixels size);
 		void SetSizeInPoints(Points size);
 
-
-		std::vector<uint8_t> fontData = {};
+		std::shared_ptr<FontFace> fontFace = {}; // Shared by all fonts of one registry entry
+		FT_SizeRec_* ftSize = nullptr;
+		FontSize fontSize = Points{ 12 };
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Font.hpp"
+
+namespace Trex
+{
+	// Shares one FT_Face and one copy of the font data between all fonts opened from the same file or bytes.
+	// Every call returns a new Font with its own FT_Size, so atlases of different sizes can share the face.
+	// A face is released when the last font using it is destroyed.
+	// Fonts sharing a face can be used on different threads. They take turns through the face lock (see Font).
+	class FontRegistry
+	{
+	public:
+		// Used by the Atlas constructors that take a font path or font data
+		static FontRegistry& Default();
+
+		// Fonts are keyed by the canonical path and the face index.
+		// All faces of a font collection (.ttc, .otc) share one mapping of the file.
+		std::shared_ptr<Font> Get(const std::string& path, long faceIndex = 0);
+		// Copied data is keyed by its hash and the face index. All faces share one copy.
+		// The bytes are compared as well, so different data with the same hash never shares a face.
+		// Borrowed data is shared only between fonts borrowing the same buffer.
+		std::shared_ptr<Font> Get(std::span<const uint8_t> data, long faceIndex = 0, DataOwnership ownership = DataOwnership::COPY);
+		// One font for every face of a font collection, ordered by face index
+		std::vector<std::shared_ptr<Font>> GetAllFaces(const std::string& path);
+
+		// Number of faces still used by at least one font
+		size_t FaceCount() const;
+		// Number of files and buffers fonts were opened from. Sources without any face alive are pruned on the next Get.
+		size_t SourceCount() const;
+
+	private:
+		// A font file or a buffer with all faces opened from it
+		struct Source
+		{
+			std::weak_ptr<const void> dataOwner; // Mapping or copy shared by all faces. Empty for borrowed data.
+			std::span<const uint8_t> data;
+			std::map<long, std::weak_ptr<FontFace>> faces;
+		};
+		// Hash of copied data or the size of borrowed data, borrowed buffer or nullptr
+		using ContentKey = std::pair<uint64_t, const uint8_t*>;
+		// Loads the data of a source when none of its faces is alive. Returns the owner of the data.
+		using LoadData = std::function<std::shared_ptr<const void>(std::span<const uint8_t>& data)>;
+
+		std::shared_ptr<Font> GetFromSource(Source& source, long faceIndex, const LoadData& loadData);
+
+		mutable std::mutex m_Mutex;
+		std::map<std::string, Source> m_SourcesByPath;
+		std::multimap<ContentKey, Source> m_SourcesByContent; // Copied data with colliding hashes has several sources
+	};
+}
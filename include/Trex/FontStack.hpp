@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trex
+{
+	class Font;
+
+	// Primary font followed by fallback fonts (e.g. emoji or CJK faces).
+	// Every codepoint resolves to the first font with a glyph for it. The resolution of all codepoints
+	// is computed once from the character maps of the fonts and kept in a compact table.
+	// Glyph indices of the fonts follow one another, so the primary font keeps its own glyph indices.
+	class FontStack
+	{
+	public:
+		explicit FontStack(std::shared_ptr<Font> font);
+		// At most 255 fonts. The first one is the primary font.
+		explicit FontStack(std::vector<std::shared_ptr<Font>> fonts);
+
+		size_t Size() const { return m_Fonts.size(); }
+		const std::shared_ptr<Font>& GetFont(size_t font) const { return m_Fonts.at(font); }
+		const std::shared_ptr<Font>& GetPrimaryFont() const { return m_Fonts.front(); }
+
+		// Position of the first font with a glyph for the codepoint.
+		// Codepoints missing from all fonts resolve to the primary font.
+		size_t ResolveCodepoint(uint32_t codepoint) const
+		{
+			const uint32_t page = codepoint / BlockSize;
+			return page < m_FontPages.size() ? m_FontBlocks[m_FontPages[page] * BlockSize + codepoint % BlockSize] : 0;
+		}
+		// Glyph index of the codepoint in the resolved font, offset by the glyph counts of the fonts before it
+		uint32_t GetGlyphIndex(uint32_t codepoint) const;
+		// First glyph index of a font
+		uint32_t GetGlyphOffset(size_t font) const { return m_GlyphOffsets[font]; }
+		// Font owning a glyph index
+		size_t GetFontOfGlyph(uint32_t glyphIndex) const;
+		// Number of glyphs of all fonts
+		uint32_t GlyphCount() const { return m_GlyphOffsets.back(); }
+
+		// Locks the faces of all fonts (see Font::LockFace). Stacks sharing faces lock them in the same order.
+		[[nodiscard]] std::vector<std::unique_lock<std::recursive_mutex>> LockFaces() const;
+
+	private:
+		static constexpr uint32_t BlockSize = 256;
+
+		void ResolveAllCodepoints();
+
+		std::vector<std::shared_ptr<Font>> m_Fonts;
+		std::vector<uint32_t> m_GlyphOffsets; // One more than fonts. The last one is the total glyph count.
+		// Two-level table from codepoints to fonts. A page holds the number of a block of 256 consecutive
+		// codepoints in m_FontBlocks. Block 0 resolves all codepoints to the primary font.
+		// The table is empty when there are no fallback fonts.
+		std::vector<uint16_t> m_FontPages;
+		std::vector<uint8_t> m_FontBlocks;
+	};
+}
@@ -1,9 +1,11 @@
 #pragma once
 #include "Atlas.hpp"
+#include <list>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include <span>
 
-struct hb_glyph_info_t;
 struct hb_glyph_position_t;
 struct hb_buffer_t;
 struct hb_font_t;
@@ -22,6 +24,39 @@ namespace Trex
 
 	using ShapedGlyphs = std::vector<ShapedGlyph>;
 
+	// Shaped text stored as separate arrays. Atlas data of a glyph is not copied, but looked up
+	// by its index (see: TextShaper::GetGlyph), so every glyph takes 20 bytes instead of 52.
+	struct ShapedText
+	{
+		std::vector<uint32_t> glyphIndices; // Index of the glyph in the atlas
+		std::vector<float> xOffsets;
+		std::vector<float> yOffsets;
+		std::vector<float> xAdvances;
+		std::vector<float> yAdvances;
+
+		size_t Size() const { return glyphIndices.size(); }
+		bool Empty() const { return glyphIndices.empty(); }
+		// Keeps the capacity, so the arrays can be reused
+		void Clear() { Resize(0); }
+		void Resize(size_t size);
+		void Reserve(size_t size);
+	};
+	// Result of shaping, which may be shared with the shape cache. It is never modified.
+	using SharedShapedGlyphs = std::shared_ptr<const ShapedGlyphs>;
+
+	struct ShapeCacheStats
+	{
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t size = 0; // Number of cached texts or words
+	};
+
+	enum class ShapeCacheMode
+	{
+		TEXT, // Whole texts, e.g. UI labels shaped every frame
+		WORDS // Words and spaces, e.g. paragraphs of chat logs and documents built from a small vocabulary
+	};
+
 	struct TextMeasurement
 	{
 		float width, height; // Width and height of the text. Measured from the top-left corner (offset)
@@ -29,10 +64,21 @@ namespace Trex
 		float xAdvance, yAdvance; // Advance from baseline origin to the end of the text (including trailing advance)
 	};
 
+	// A shaper must be used on one thread at a time. Shapers on different threads may share a static atlas.
+	// Every shaper shapes with its own clones of the fonts, so shapers never wait for each other.
+	// Text of an atlas with fallback fonts is split into runs of one font, which are shaped separately.
+	// With a cache atlas, a glyph loaded late in a text may evict a glyph loaded earlier in the same text
+	// and take its region. Shape the text again when TakeDirtyRegions returns regions after shaping.
 	class TextShaper
 	{
 	public:
+		// The shaper keeps the glyph table the atlas has now, so the atlas can be destroyed.
 		explicit TextShaper(const Atlas& atlas);
+
+		struct LoadMissingGlyphs {}; // Tag of the constructor binding a shaper to a dynamic atlas
+		// Glyphs missing from a dynamic atlas are added to it during shaping.
+		// The atlas must outlive the shaper and must not be moved.
+		TextShaper(Atlas& atlas, LoadMissingGlyphs);
 		~TextShaper();
 
 		ShapedGlyphs ShapeAscii(const std::span<const char> text)
@@ -44,21 +90,119 @@ namespace Trex
 		ShapedGlyphs ShapeUtf32(std::span<const char32_t> text);
 		ShapedGlyphs ShapeUnicode(std::span<const uint32_t> codepoints);
 
+		// Append the glyphs to `output`. Reusing the output (e.g. clearing it every frame) avoids all heap
+		// allocations once it is large enough, except for texts missing from the shape cache.
+		void ShapeAscii(const std::span<const char> text, ShapedGlyphs& output)
+		{
+			ShapeUtf8(text, output);
+		}
+		void ShapeUtf8(std::span<const char> text, ShapedGlyphs& output);
+		void ShapeUtf32(std::span<const char32_t> text, ShapedGlyphs& output);
+		void ShapeUnicode(std::span<const uint32_t> codepoints, ShapedGlyphs& output);
+
+		// Append the glyphs to `output` stored as separate arrays
+		void ShapeAscii(const std::span<const char> text, ShapedText& output)
+		{
+			ShapeUtf8(text, output);
+		}
+		void ShapeUtf8(std::span<const char> text, ShapedText& output);
+		void ShapeUtf32(std::span<const char32_t> text, ShapedText& output);
+		void ShapeUnicode(std::span<const uint32_t> codepoints, ShapedText& output);
+		// Atlas data of a glyph of ShapedText
+		const Glyph& GetGlyph(uint32_t glyphIndex) const;
+
+		// Same as ShapeUtf8/ShapeUnicode, but a cached result is returned without copying it.
+		SharedShapedGlyphs ShapeUtf8Shared(std::span<const char> text);
+		SharedShapedGlyphs ShapeUnicodeShared(std::span<const uint32_t> codepoints);
+
+		// Keep the results of up to `capacity` recently shaped texts or words. 0 disables the cache (default).
+		// Changing the mode clears the cache.
+		void SetCacheCapacity(size_t capacity, ShapeCacheMode mode = ShapeCacheMode::TEXT);
+		ShapeCacheStats GetCacheStats() const;
+		void ClearCache();
+
 		FontMetrics GetFontMetrics() const;
 
 		static TextMeasurement Measure(const ShapedGlyphs&);
+		TextMeasurement Measure(const ShapedText&) const;
 
 	private:
+		// Characters of the text resolved to one font of the stack
+		struct FontRun
+		{
+			size_t font;
+			unsigned int offset; // In the units of the text (bytes of UTF-8 or codepoints)
+			unsigned int length;
+		};
+
+		enum class TextEncoding : uint8_t { UTF8, UTF32, UNICODE };
+		template<typename Char>
+		static constexpr TextEncoding EncodingOf()
+		{
+			if constexpr (std::is_same_v<Char, char>)
+				return TextEncoding::UTF8;
+			else if constexpr (std::is_same_v<Char, char32_t>)
+				return TextEncoding::UTF32;
+			else
+				return TextEncoding::UNICODE;
+		}
+
+		struct CacheEntry
+		{
+			uint64_t hash;
+			TextEncoding encoding;
+			std::vector<uint8_t> text; // Compared on a hit, so a hash collision is never returned
+			SharedShapedGlyphs glyphs; // Null for a word which cannot be shaped on its own
+		};
+
+		struct GlyphCluster
+		{
+			unsigned int cluster; // Offset of the first character of the glyph in the text
+			bool unsafeToBreak; // HarfBuzz would shape the text differently if it were split before this glyph
+		};
+
+		// The cluster of every added glyph is added to `clusters`
+		template<typename AddText, typename Output>
+		void Shape(AddText addText, unsigned int textLength, Output& output, std::vector<GlyphCluster>* clusters = nullptr);
+		template<typename Char, typename Output>
+		void ShapeText(std::span<const Char> text, Output& output, std::vector<GlyphCluster>* clusters = nullptr);
+		template<typename Char, typename Output>
+		void ShapeInto(std::span<const Char> text, Output& output);
+		template<typename Char>
+		SharedShapedGlyphs ShapeShared(std::span<const Char> text);
+		template<typename Char>
+		SharedShapedGlyphs ShapeCached(std::span<const Char> text);
+		template<typename Char, typename Output>
+		bool AddWordGlyphs(std::span<const Char> text, Output& output);
+		template<typename Char>
+		SharedShapedGlyphs ShapeWord(std::span<const Char> word);
+		const CacheEntry* FindCacheEntry(uint64_t hash, TextEncoding, std::span<const uint8_t> text);
+		SharedShapedGlyphs AddCacheEntry(uint64_t hash, TextEncoding, std::span<const uint8_t> text, SharedShapedGlyphs);
+		void RefreshAtlasGlyphs(CacheEntry&);
+		void FindFontRuns(unsigned int textLength);
 		Glyph GetAtlasGlyph(uint32_t glyphIndex);
-		ShapedGlyphs GetShapedGlyphs();
-		ShapedGlyph GetShapedGlyph(const hb_glyph_info_t& glyphInfo, const hb_glyph_position_t& glyphPos);
+		template<typename Output>
+		void AddShapedGlyphs(size_t font, Output& output, std::vector<GlyphCluster>* clusters);
+		void AddShapedGlyph(uint32_t glyphIndex, const hb_glyph_position_t& glyphPos, ShapedGlyphs& output);
+		void AddShapedGlyph(uint32_t glyphIndex, const hb_glyph_position_t& glyphPos, ShapedText& output);
 		void ResetBuffer();
+		void ShapeBuffer(size_t font);
 
-		Atlas::Glyphs m_Glyphs;
-		std::shared_ptr<const Font> m_AtlasFont;
+		std::shared_ptr<const Atlas::Glyphs> m_Glyphs; // Shared with the atlas. Null when the atlas is dynamic.
+		std::shared_ptr<const FontStack> m_Fonts;
+		Atlas* m_DynamicAtlas = nullptr;
 
 		hb_buffer_t* m_Buffer;
-		hb_font_t* m_Font;
+		std::vector<Font> m_ShapingFonts; // Clones of the fonts of the stack
+		std::vector<hb_font_t*> m_HarfBuzzFonts; // One for every clone
+		std::vector<FontRun> m_FontRuns; // Reused by every text, so shaping does not allocate
+		std::vector<uint32_t> m_Utf32Text; // UTF-32 text converted for HarfBuzz. Reused like m_FontRuns.
+
+		size_t m_CacheCapacity = 0;
+		ShapeCacheMode m_CacheMode = ShapeCacheMode::TEXT;
+		std::list<CacheEntry> m_CacheEntries; // Most recently used first
+		std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> m_CacheIndex; // By the hash of the text
+		ShapeCacheStats m_CacheStats;
 	};
 
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "Trex/Atlas.hpp"
 #include "Trex/Font.hpp"
+#include "Trex/FontRegistry.hpp"
+#include "Trex/FontStack.hpp"
+#include "Packer.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "BlitKernels.hpp"
 #include <ft2build.h>
 #include <sdf/ftsdfrend.h>
 #include FT_FREETYPE_H
@@ -8,7 +14,19 @@
 #include <string_view>
 #include <stdexcept>
 #include <map>
+#include <unordered_map>
 #include <cassert>
+#include <algorithm>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <utility>
+#include <tuple>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <type_traits>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define	STB_IMAGE_WRITE_STATIC
@@ -21,8 +39,8 @@ namespace Trex
 	class Atlas::FreeTypeGlyph
 	{
 	public:
-		FreeTypeGlyph( uint32_t codepoint, FT_GlyphSlot glyphSlot )
-			: codepoint{codepoint}
+		FreeTypeGlyph( uint32_t codepoint, uint32_t glyphIndex, FT_GlyphSlot glyphSlot )
+			: codepoint{codepoint}, glyphIndex{glyphIndex}
 		{
 			if (glyphSlot == nullptr)
 				throw std::runtime_error( "Glyph slot is null" );
@@ -30,7 +48,6 @@ namespace Trex
 				throw std::runtime_error( "Glyph format must be a bitmap" );
 
 			metrics = glyphSlot->metrics;
-			glyphIndex = glyphSlot->glyph_index;
 
 			FT_Glyph genericGlyph;
 			FT_Error error = FT_Get_Glyph( glyphSlot, &genericGlyph );
@@ -99,51 +116,8 @@ namespace Trex
 			}
 		}
 
-		uint8_t ColorRed( int x, int y ) const
-		{
-			int offset = 0;
-			switch( glyph->bitmap.pixel_mode )
-			{
-			case FT_PIXEL_MODE_BGRA: offset = 2; break;
-			}
-
-			return ByteAt( x * Channels() + offset, y);
-		}
-		uint8_t ColorGreen( int x, int y ) const
-		{
-			int offset = 0;
-			switch( glyph->bitmap.pixel_mode )
-			{
-			case FT_PIXEL_MODE_LCD:
-			case FT_PIXEL_MODE_BGRA: offset = 1; break;
-			}
-			return ByteAt( x * Channels() + offset, y );
-		}
-		uint8_t ColorBlue( int x, int y ) const
-		{
-			int offset = 0;
-			switch( glyph->bitmap.pixel_mode )
-			{
-			case FT_PIXEL_MODE_LCD: offset = 2; break;
-			}
-
-			return ByteAt( x * Channels() + offset, y);
-		}
-		uint8_t ColorAlpha( int x, int y ) const
-		{
-			if( glyph->bitmap.pixel_mode == FT_PIXEL_MODE_BGRA )
-			{
-				return ByteAt( x * Channels() + 3, y);
-			}
-			if( glyph->bitmap.pixel_mode == FT_PIXEL_MODE_LCD )
-			{
-				return 255;
-			}
-			
-			return ByteAt(x * Channels(), y);
-		}
-
 		int Index() const { return glyphIndex; }
+		const FT_Glyph_Metrics& Metrics() const { return metrics; }
 
 	private:
 		uint32_t codepoint {};
@@ -156,10 +130,10 @@ namespace Trex
 namespace
 {
 	// Note: calling this function will invalidate the previous FT_GlyphSlot returned.
-	FT_GlyphSlot LoadGlyphWithoutRender(FT_Face fontFace, uint32_t codepoint, bool color = false)
+	FT_GlyphSlot LoadGlyphWithoutRender(FT_Face fontFace, uint32_t glyphIndex, bool color = false)
 	{
 		FT_Int32 flags = color ? FT_LOAD_COLOR : FT_LOAD_DEFAULT;
-		FT_Error error = FT_Load_Char(fontFace, codepoint, flags );
+		FT_Error error = FT_Load_Glyph(fontFace, glyphIndex, flags );
 		if (error)
 		{
 			throw std::runtime_error("Error: could not load and render char");
@@ -168,9 +142,9 @@ namespace
 		return fontFace->glyph;
 	}
 
-	FT_GlyphSlot LoadGlyphWithGrayscaleRender(FT_Face fontFace, uint32_t codepoint)
+	FT_GlyphSlot LoadGlyphWithGrayscaleRender(FT_Face fontFace, uint32_t glyphIndex)
 	{
-		auto glyph = LoadGlyphWithoutRender(fontFace, codepoint, false);
+		auto glyph = LoadGlyphWithoutRender(fontFace, glyphIndex, false);
 
 		FT_Error error = FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL);
 		if (error)
@@ -180,9 +154,9 @@ namespace
 		return glyph;
 	}
 
-	FT_GlyphSlot LoadGlyphWithColorRender( FT_Face fontFace, uint32_t codepoint )
+	FT_GlyphSlot LoadGlyphWithColorRender( FT_Face fontFace, uint32_t glyphIndex )
 	{
-		auto glyph = LoadGlyphWithoutRender( fontFace, codepoint, true );
+		auto glyph = LoadGlyphWithoutRender( fontFace, glyphIndex, true );
 
 		FT_Error error = FT_Render_Glyph( glyph, FT_RENDER_MODE_NORMAL );
 		if( error )
@@ -192,12 +166,12 @@ namespace
 		return glyph;
 	}
 
-	FT_GlyphSlot LoadGlyphWithSdfRender( FT_Face fontFace, uint32_t codepoint )
+	FT_GlyphSlot LoadGlyphWithSdfRender( FT_Face fontFace, uint32_t glyphIndex )
 	{
 		// Use bsdf renderer instead of sdf renderer.
 		// See: https://freetype.org/freetype2/docs/reference/ft2-base_interface.html#ft_render_mode
 		// First I need to render the glyph with normal mode, then render it with sdf mode.
-		auto glyph = LoadGlyphWithGrayscaleRender( fontFace, codepoint );
+		auto glyph = LoadGlyphWithGrayscaleRender( fontFace, glyphIndex );
 
 		// But the bsdf renderer cannot handle the glyph with zero width or height (e.g. space).
 		// It is a result of a bug in FreeType. It is already fixed on master branch. (86d0ca24)
@@ -213,12 +187,12 @@ namespace
 		return glyph;
 	}
 
-	FT_GlyphSlot LoadGlyphWithSubpixelRender( FT_Face fontFace, uint32_t codepoint )
+	FT_GlyphSlot LoadGlyphWithSubpixelRender( FT_Face fontFace, uint32_t glyphIndex )
 	{
-		auto glyphNormal = LoadGlyphWithoutRender( fontFace, codepoint );
+		auto glyphNormal = LoadGlyphWithoutRender( fontFace, glyphIndex );
 		auto normalWidth = glyphNormal->bitmap.width;
 
-		FT_Load_Char( fontFace, codepoint, FT_LOAD_DEFAULT );
+		FT_Load_Glyph( fontFace, glyphIndex, FT_LOAD_DEFAULT );
 		FT_Render_Glyph( fontFace->glyph, FT_RENDER_MODE_LCD );
 
 		auto& glyph = fontFace->glyph;
@@ -226,141 +200,478 @@ namespace
 		return fontFace->glyph;
 	}
 
-	Atlas::FreeTypeGlyph LoadGlyph( FT_Face fontFace, uint32_t codepoint, RenderMode mode )
+	constexpr uint32_t MaxCodepoint = 0x10FFFF;
+	// Number of consecutive codepoints in a block of the codepoint page table.
+	constexpr uint32_t CodepointBlockSize = 256;
+
+	struct GlyphToLoad
+	{
+		uint32_t codepoint;
+		uint32_t glyphIndex; // In the font stack
+		uint32_t fontGlyphIndex; // In the font owning the glyph
+		size_t font; // Position of the font in the stack
+	};
+
+	// One FreeType face of every font in the stack
+	using FontFaces = std::vector<FT_Face>;
+
+	GlyphToLoad MakeGlyphToLoad( const FontStack& fonts, uint32_t codepoint, uint32_t glyphIndex )
+	{
+		const size_t font = fonts.GetFontOfGlyph( glyphIndex );
+		return { codepoint, glyphIndex, glyphIndex - fonts.GetGlyphOffset( font ), font };
+	}
+
+	FontFaces GetFaces( const FontStack& fonts )
+	{
+		FontFaces faces;
+		faces.reserve( fonts.Size() );
+		for( size_t font = 0; font < fonts.Size(); ++font )
+		{
+			faces.push_back( fonts.GetFont( font )->face );
+		}
+		return faces;
+	}
+
+	Atlas::FreeTypeGlyph LoadGlyph( FT_Face fontFace, const GlyphToLoad& glyph, RenderMode mode )
 	{
 		switch( mode )
 		{
 			case RenderMode::DEFAULT:
-				return Atlas::FreeTypeGlyph { codepoint, LoadGlyphWithGrayscaleRender( fontFace, codepoint ) };
+				return Atlas::FreeTypeGlyph { glyph.codepoint, glyph.glyphIndex, LoadGlyphWithGrayscaleRender( fontFace, glyph.fontGlyphIndex ) };
 			case RenderMode::COLOR:
-				return Atlas::FreeTypeGlyph { codepoint, LoadGlyphWithColorRender( fontFace, codepoint ) };
+				return Atlas::FreeTypeGlyph { glyph.codepoint, glyph.glyphIndex, LoadGlyphWithColorRender( fontFace, glyph.fontGlyphIndex ) };
 			case RenderMode::SDF:
-				return Atlas::FreeTypeGlyph { codepoint, LoadGlyphWithSdfRender( fontFace, codepoint ) };
+				return Atlas::FreeTypeGlyph { glyph.codepoint, glyph.glyphIndex, LoadGlyphWithSdfRender( fontFace, glyph.fontGlyphIndex ) };
 			case RenderMode::LCD:
-				return Atlas::FreeTypeGlyph { codepoint, LoadGlyphWithSubpixelRender( fontFace, codepoint ) };
+				return Atlas::FreeTypeGlyph { glyph.codepoint, glyph.glyphIndex, LoadGlyphWithSubpixelRender( fontFace, glyph.fontGlyphIndex ) };
 			default:
 				throw std::runtime_error( "Unsupported render mode" );
 		}
 	}
 
-	std::vector<Atlas::FreeTypeGlyph> LoadAllGlyphs( FT_Face fontFace, const Charset& charset, RenderMode mode )
+	/**
+	* Many codepoints can map to the same glyph (e.g. aliases, compatibility forms or all codepoints
+	* missing from the font). Every glyph index is loaded only once, in the order of its first codepoint.
+	* The glyph keeps the last codepoint mapped to it, like the glyph table did when duplicates were added.
+	* Every codepoint is mapped in the codepoint table of the glyphs, so later lookups skip FreeType.
+	* Each codepoint is taken from the first font of the stack that has it.
+	*/
+	std::vector<GlyphToLoad> GetUniqueGlyphs( const FontStack& fonts, const Charset& charset, Atlas::Glyphs& codepointTable )
+	{
+		std::vector<GlyphToLoad> glyphs;
+		glyphs.reserve( charset.Size() );
+		std::unordered_map<uint32_t, size_t> positions;
+		positions.reserve( charset.Size() );
+		for( uint32_t codepoint : charset )
+		{
+			const size_t font = fonts.ResolveCodepoint( codepoint );
+			const uint32_t fontGlyphIndex = FT_Get_Char_Index( fonts.GetFont( font )->face, codepoint );
+			const uint32_t glyphIndex = fonts.GetGlyphOffset( font ) + fontGlyphIndex;
+			codepointTable.MapCodepoint( codepoint, glyphIndex );
+			auto [position, isNew] = positions.try_emplace( glyphIndex, glyphs.size() );
+			if( isNew )
+			{
+				glyphs.push_back( { codepoint, glyphIndex, fontGlyphIndex, font } );
+			}
+			else
+			{
+				glyphs[ position->second ].codepoint = codepoint;
+			}
+		}
+
+		return glyphs;
+	}
+
+	// Number of consecutive glyphs taken by a worker at once.
+	constexpr size_t WorkerChunkSize = 64;
+
+	unsigned int GetWorkerCount( unsigned int threads, size_t glyphCount )
 	{
+		if( threads == 0 )
+		{
+			threads = std::max( 1u, std::thread::hardware_concurrency() );
+		}
+		size_t chunks = ( glyphCount + WorkerChunkSize - 1 ) / WorkerChunkSize;
+		return static_cast<unsigned int>( std::clamp<size_t>( chunks, 1, threads ) );
+	}
+
+	/**
+	* Call process(faces, i) for every glyph on a pool of workers. Each worker uses its own clones
+	* of the fonts, so no FreeType object is shared between threads. Without worker faces, all glyphs
+	* are processed on the calling thread with the given faces.
+	*
+	* @param workerFaces - Faces of every worker. Their fonts must outlive everything the workers loaded.
+	*/
+	template<typename Process>
+	void ForEachGlyph( const FontFaces& faces, const std::vector<FontFaces>& workerFaces, size_t glyphCount, Process process )
+	{
+		if( workerFaces.empty() )
+		{
+			for( size_t i = 0; i < glyphCount; ++i )
+			{
+				process( faces, i );
+			}
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors( workerFaces.size() );
+		std::atomic<size_t> nextChunk = 0;
+
+		auto worker = [&]( const FontFaces& workerFace, std::exception_ptr& error ) {
+			try
+			{
+				size_t first;
+				while( ( first = nextChunk.fetch_add( WorkerChunkSize ) ) < glyphCount )
+				{
+					size_t last = std::min( first + WorkerChunkSize, glyphCount );
+					for( size_t i = first; i < last; ++i )
+					{
+						process( workerFace, i );
+					}
+				}
+			}
+			catch( ... )
+			{
+				error = std::current_exception();
+				nextChunk = glyphCount; // Stop other workers
+			}
+		};
+
+		{
+			std::vector<std::jthread> pool;
+			pool.reserve( workerFaces.size() );
+			for( size_t i = 0; i < workerFaces.size(); ++i )
+			{
+				pool.emplace_back( worker, std::cref( workerFaces[ i ] ), std::ref( errors[ i ] ) );
+			}
+		} // Join all workers
+
+		for( const auto& error : errors )
+		{
+			if( error )
+				std::rethrow_exception( error );
+		}
+	}
+
+	/**
+	* Every glyph is stored at its position in the list, so the result does not depend on the number of workers.
+	*/
+	std::vector<Atlas::FreeTypeGlyph> LoadAllGlyphs(
+		const FontFaces& faces, const std::vector<FontFaces>& workerFaces, std::span<const GlyphToLoad> glyphs, RenderMode mode )
+	{
+		std::vector<std::optional<Atlas::FreeTypeGlyph>> loadedGlyphs( glyphs.size() );
+		ForEachGlyph( faces, workerFaces, glyphs.size(), [&]( const FontFaces& threadFaces, size_t i ) {
+			loadedGlyphs[ i ].emplace( LoadGlyph( threadFaces[ glyphs[ i ].font ], glyphs[ i ], mode ) );
+		} );
+
 		std::vector<Atlas::FreeTypeGlyph> allGlyphs;
-		allGlyphs.reserve( charset.Size() );
-		for( uint32_t codepoint : charset.Codepoints() )
+		allGlyphs.reserve( loadedGlyphs.size() );
+		for( auto& glyph : loadedGlyphs )
 		{
-			allGlyphs.push_back( LoadGlyph( fontFace, codepoint, mode ) );
+			allGlyphs.push_back( std::move( *glyph ) );
 		}
 
 		return allGlyphs;
 	}
 
+	Glyph MakeGlyph( uint32_t codepoint, uint32_t glyphIndex, unsigned int width, unsigned int height, const FT_Glyph_Metrics& metrics )
+	{
+		return Glyph {
+			.codepoint = codepoint,
+			.glyphIndex = glyphIndex,
+			.x = 0,
+			.y = 0,
+			.width = width,
+			.height = height,
+			.bearingX = (int)(metrics.horiBearingX / 64),
+			.bearingY = (int)(metrics.horiBearingY / 64)
+		};
+	}
+
 	/**
-	* Try to fill all glyphs into the atlas with the given size.
-	* Return true if all glyphs can fit into the atlas.
-	* 
-	* @param ftGlyphs - FreeType glyphs to be placed into the atlas.
-	* @param atlasSize - Size of the atlas in pixels.
-	* @param padding - Padding between glyphs in pixels.
-	* 
-	* @return True if all glyphs can fit into the atlas, false otherwise.
+	* Get the size and metrics of a glyph without keeping its bitmap.
+	* FreeType presets the bitmap size of an outline glyph when it is loaded, so in the default mode
+	* nothing is rendered. Other modes change the size while rendering, so the glyph is rendered and dropped.
 	*/
-	bool IsAtlasSizeEnough(const std::vector<Atlas::FreeTypeGlyph>& ftGlyphs, unsigned int atlasSize, int padding)
+	Glyph MeasureGlyph( const FontFaces& faces, const GlyphToLoad& glyph, RenderMode mode )
 	{
-		int x = 0;
-		int y = 0;
-		unsigned int maxHeight = 0;
-		for (const auto& glyph : ftGlyphs)
+		if( mode == RenderMode::DEFAULT )
 		{
-			unsigned int glyphWidth = glyph.Width() + padding * 2;
-			unsigned int glyphHeight = glyph.Height() + padding * 2;
+			FT_GlyphSlot slot = LoadGlyphWithoutRender( faces[ glyph.font ], glyph.fontGlyphIndex );
+			if( slot->format == FT_GLYPH_FORMAT_OUTLINE )
+			{
+				return MakeGlyph( glyph.codepoint, glyph.glyphIndex, slot->bitmap.width, slot->bitmap.rows, slot->metrics );
+			}
+		}
+
+		Atlas::FreeTypeGlyph ftGlyph = LoadGlyph( faces[ glyph.font ], glyph, mode );
+		return MakeGlyph( glyph.codepoint, glyph.glyphIndex, ftGlyph.Width(), ftGlyph.Height(), ftGlyph.Metrics() );
+	}
+
+	std::vector<Glyph> MeasureAllGlyphs(
+		const FontFaces& faces, const std::vector<FontFaces>& workerFaces, std::span<const GlyphToLoad> glyphs, RenderMode mode )
+	{
+		std::vector<Glyph> measuredGlyphs( glyphs.size() );
+		ForEachGlyph( faces, workerFaces, glyphs.size(), [&]( const FontFaces& threadFaces, size_t i ) {
+			measuredGlyphs[ i ] = MeasureGlyph( threadFaces, glyphs[ i ], mode );
+		} );
+		return measuredGlyphs;
+	}
 
-			maxHeight = std::max(maxHeight, glyphHeight);
-			if (x + glyphWidth > atlasSize) // Next row
+	std::vector<PackerRect> GetPackerRects( std::span<const Glyph> glyphs, int padding )
+	{
+		std::vector<PackerRect> rects;
+		rects.reserve( glyphs.size() );
+		for( const Glyph& glyph : glyphs )
+		{
+			rects.push_back( { glyph.width + padding * 2, glyph.height + padding * 2 } );
+		}
+		return rects;
+	}
+
+	/**
+	* Render every glyph straight into its place in the atlas and free it.
+	* Glyphs never overlap, so workers can draw into the same bitmaps at once.
+	*/
+	void RenderAllGlyphs( const FontFaces& faces, const std::vector<FontFaces>& workerFaces, std::span<const GlyphToLoad> glyphsToLoad,
+		std::span<Glyph> glyphs, std::vector<Atlas::Bitmap>& bitmaps, const AtlasLayout& layout, int padding, RenderMode mode )
+	{
+		ForEachGlyph( faces, workerFaces, glyphs.size(), [&]( const FontFaces& threadFaces, size_t i ) {
+			Glyph& glyph = glyphs[ i ];
+			glyph.x = layout.positions[ i ].x + padding;
+			glyph.y = layout.positions[ i ].y + padding;
+			glyph.page = layout.pages.empty() ? 0 : layout.pages[ i ];
+			if( glyph.width == 0 || glyph.height == 0 )
 			{
-				x = 0;
-				y += static_cast<int>(maxHeight);
-				maxHeight = glyphHeight;
+				return; // Nothing to draw
 			}
-			if (y + glyphHeight > atlasSize)
+
+			Atlas::FreeTypeGlyph ftGlyph = LoadGlyph( threadFaces[ glyphsToLoad[ i ].font ], glyphsToLoad[ i ], mode );
+			if( ftGlyph.Width() != glyph.width || ftGlyph.Height() != glyph.height )
+			{
+				throw std::runtime_error( "Error: glyph size changed between measuring and rendering" );
+			}
+			bitmaps[ glyph.page ].Draw( glyph.x, glyph.y, ftGlyph );
+		} );
+	}
+
+	bool HaveIdenticalBitmaps(const Atlas::FreeTypeGlyph& a, const Atlas::FreeTypeGlyph& b)
+	{
+		if (a.Width() != b.Width() || a.Height() != b.Height() || a.Channels() != b.Channels())
+		{
+			return false;
+		}
+
+		const size_t rowSize = static_cast<size_t>(a.Width()) * a.Channels();
+		for (unsigned int y = 0; rowSize > 0 && y < a.Height(); ++y)
+		{
+			if (not std::equal(&a.ByteAt(0, y), &a.ByteAt(0, y) + rowSize, &b.ByteAt(0, y)))
 			{
 				return false;
 			}
-			x += static_cast<int>(glyphWidth);
 		}
 		return true;
 	}
 
 	/**
-	* Get the smallest atlas size that can fit all glyphs.
-	* 
-	* @param glyphsMetrics - Metrics of the glyphs to be placed into the atlas.
-	* @param padding - Padding between glyphs in pixels.
-	* 
-	* @return The smallest atlas size in pixels that can fit all glyphs. 
-	*         The atlas size is always a square with the power of 2.
+	* For every glyph find the first glyph with an identical bitmap. Different glyphs often look the same
+	* (e.g. Latin 'A' and Cyrillic 'A'), so such bitmap can be stored in the atlas only once.
 	*/
-	unsigned int GetAtlasSize(const std::vector<Atlas::FreeTypeGlyph>& glyphsMetrics, int padding)
+	std::vector<size_t> FindIdenticalBitmaps(const std::vector<Atlas::FreeTypeGlyph>& ftGlyphs)
 	{
-		unsigned int atlasSize = 128; // Start with 128x128
-		while (not IsAtlasSizeEnough(glyphsMetrics, atlasSize, padding))
+		std::vector<size_t> sources(ftGlyphs.size());
+		std::unordered_multimap<uint64_t, size_t> glyphsByHash;
+		for (size_t i = 0; i < ftGlyphs.size(); ++i)
 		{
-			atlasSize *= 2;
+			const auto& glyph = ftGlyphs[i];
+			const size_t rowSize = static_cast<size_t>(glyph.Width()) * glyph.Channels();
+			uint64_t hash = HashValue(glyph.Width());
+			hash = HashValue(glyph.Height(), hash);
+			for (unsigned int y = 0; rowSize > 0 && y < glyph.Height(); ++y)
+			{
+				hash = HashBytes({ &glyph.ByteAt(0, y), rowSize }, hash);
+			}
+
+			sources[i] = i;
+			auto [first, last] = glyphsByHash.equal_range(hash);
+			auto identical = std::find_if(first, last, [&](const auto& entry) { return HaveIdenticalBitmaps(ftGlyphs[entry.second], glyph); });
+			if (identical != last)
+			{
+				sources[i] = identical->second;
+			}
+			else
+			{
+				glyphsByHash.emplace(hash, i);
+			}
 		}
+		return sources;
+	}
 
-		return atlasSize;
+	/**
+	* @param bitmapSources - Glyph with the bitmap of each glyph. Only glyphs with their own bitmap are packed.
+	*                        Empty when all glyphs are packed.
+	*/
+	std::vector<PackerRect> GetPackerRects(const std::vector<Atlas::FreeTypeGlyph>& ftGlyphs, int padding, std::span<const size_t> bitmapSources)
+	{
+		std::vector<PackerRect> rects;
+		rects.reserve(ftGlyphs.size());
+		for (size_t i = 0; i < ftGlyphs.size(); ++i)
+		{
+			if (bitmapSources.empty() || bitmapSources[i] == i)
+			{
+				rects.push_back({ ftGlyphs[i].Width() + padding * 2, ftGlyphs[i].Height() + padding * 2 });
+			}
+		}
+		return rects;
 	}
 
-	Atlas::Bitmap BuildAtlasBitmap(
-		Atlas::Glyphs& glyphs, const std::vector<Atlas::FreeTypeGlyph>& ftGlyphs, unsigned int atlasSize, int padding, int channels)
+	// Expand the layout of packed glyphs to all glyphs. Glyphs with identical bitmaps share the position.
+	AtlasLayout ShareIdenticalBitmaps(AtlasLayout packed, std::span<const size_t> bitmapSources)
 	{
-		Atlas::Bitmap bitmap(atlasSize, atlasSize, channels);
+		std::vector<PackerPosition> positions(bitmapSources.size());
+		std::vector<unsigned int> pages(bitmapSources.size());
+		std::vector<size_t> packedIndices(bitmapSources.size());
+		size_t nextPackedIndex = 0;
+		for (size_t i = 0; i < bitmapSources.size(); ++i)
+		{
+			if (bitmapSources[i] == i)
+			{
+				packedIndices[i] = nextPackedIndex++;
+			}
+			const size_t packedIndex = packedIndices[bitmapSources[i]]; // Source is never after the glyph
+			positions[i] = packed.positions[packedIndex];
+			pages[i] = packed.pages.empty() ? 0 : packed.pages[packedIndex];
+		}
 
-		int atlasX = 0;
-		int atlasY = 0;
-		int maxHeight = 0;
-		for (const auto& glyph: ftGlyphs)
+		packed.positions = std::move(positions);
+		packed.pages = std::move(pages);
+		return packed;
+	}
+
+	std::vector<Atlas::Bitmap> CreateAtlasBitmaps(const AtlasLayout& layout, int channels)
+	{
+		std::vector<Atlas::Bitmap> bitmaps;
+		bitmaps.reserve(layout.pageCount);
+		for (unsigned int page = 0; page < layout.pageCount; ++page)
 		{
-			unsigned int glyphWidth = glyph.Width();
-			unsigned int glyphHeight = glyph.Height();
+			bitmaps.emplace_back(layout.width, layout.height, channels);
+		}
+		return bitmaps;
+	}
 
-			int glyphWidthPadding = static_cast<int>(glyphWidth) + padding * 2;
-			int glyphHeightPadding = static_cast<int>(glyphHeight) + padding * 2;
+	std::vector<Atlas::Bitmap> BuildAtlasBitmaps(
+		Atlas::Glyphs& glyphs, const std::vector<Atlas::FreeTypeGlyph>& ftGlyphs, const AtlasLayout& layout, int padding, int channels,
+		std::span<const size_t> bitmapSources)
+	{
+		std::vector<Atlas::Bitmap> bitmaps = CreateAtlasBitmaps(layout, channels);
 
-			maxHeight = std::max(maxHeight, glyphHeightPadding);
-			// If we are out of atlas bounds, go to the next line
-			if (atlasX + glyphWidthPadding * channels > atlasSize * channels)
+		for (size_t i = 0; i < ftGlyphs.size(); ++i)
+		{
+			// Copy glyph bitmap to atlas bitmap
+			int glyphXPosInBitmap = layout.positions[i].x + padding; // in pixels
+			int glyphYPosInBitmap = layout.positions[i].y + padding;
+			unsigned int page = layout.pages.empty() ? 0 : layout.pages[i];
+
+			if( bitmapSources.empty() || bitmapSources[i] == i )
 			{
-				atlasX = 0;
-				atlasY += maxHeight;
-				maxHeight = glyphHeightPadding;
+				bitmaps[page].Draw( glyphXPosInBitmap, glyphYPosInBitmap, ftGlyphs[i] );
 			}
+			glyphs.Add( glyphXPosInBitmap, glyphYPosInBitmap, ftGlyphs[i], page );
+		}
 
-			// Copy glyph bitmap to atlas bitmap
-			int glyphXPosInBitmap = atlasX / channels + padding; // in pixels
-			int glyphYPosInBitmap = atlasY + padding;
+		return bitmaps;
+	}
 
-			bitmap.Draw( glyphXPosInBitmap, glyphYPosInBitmap, glyph );
-			glyphs.Add( glyphXPosInBitmap, glyphYPosInBitmap, glyph );
+	// Layout of the cache file header. The codepoint pages, codepoint blocks, glyph table
+	// and bitmap pages follow it directly.
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t glyphSize; // Files written by a build with a different Glyph layout are rejected
+		uint32_t tableSize; // Entries of the glyph table, including glyphs missing from the atlas
+		uint64_t inputHash;
+		uint32_t unknownGlyphIndex;
+		uint32_t codepointPageCount, codepointBlockCount;
+		uint32_t pageCount;
+		uint32_t pageWidth, pageHeight;
+		uint32_t channels;
+		FontMetrics metrics; // Metrics of the primary font at the atlas size
+	};
+	static_assert(std::is_trivially_copyable_v<CacheHeader> && std::is_trivially_copyable_v<Glyph>);
 
-			atlasX += glyphWidthPadding * channels;
-		}
+	constexpr char CacheMagic[4] = { 'T', 'R', 'E', 'X' };
+	constexpr uint32_t CacheVersion = 2;
+
+	template<typename T>
+	void WriteArray(std::ofstream& file, const std::vector<T>& values)
+	{
+		file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+	}
+
+	/**
+	* Copies `count` values from the cache data and advances it. The data may not be aligned for T.
+	*/
+	template<typename T>
+	std::vector<T> ReadArray(const uint8_t*& data, size_t count)
+	{
+		std::vector<T> values(count);
+		std::copy_n(data, count * sizeof(T), reinterpret_cast<uint8_t*>(values.data()));
+		data += count * sizeof(T);
+		return values;
+	}
+
+	bool operator==(const FontMetrics& a, const FontMetrics& b)
+	{
+		return a.ascender == b.ascender && a.descender == b.descender && a.height == b.height;
+	}
+
+	/**
+	* A glyph of a cache file must lie inside one of its pages. Otherwise a corrupted file
+	* would give glyph rects outside of the bitmap.
+	*/
+	bool IsInsidePages(const Glyph& glyph, const CacheHeader& header)
+	{
+		return glyph.page < header.pageCount && glyph.x >= 0 && glyph.y >= 0
+			&& static_cast<uint64_t>(glyph.x) + glyph.width <= header.pageWidth
+			&& static_cast<uint64_t>(glyph.y) + glyph.height <= header.pageHeight;
+	}
 
-		return bitmap;
+	uint64_t HashBuildInputs(int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+	{
+		uint64_t hash = HashValue(fontSize);
+		hash = HashValue(static_cast<int>(mode), hash);
+		hash = HashValue(padding, hash);
+		hash = HashValue(static_cast<int>(options.packing), hash);
+		hash = HashValue(static_cast<int>(options.size), hash);
+		hash = HashValue(options.maxPageSize, hash);
+		hash = HashValue(options.deduplicateBitmaps, hash);
+		hash = HashValue(charset.IsFull(), hash);
+		for (const auto& [first, last] : charset.Ranges())
+		{
+			hash = HashValue(first, hash);
+			hash = HashValue(last, hash);
+		}
+		return hash;
 	}
 
-	Charset GetFullCharsetFilled(Font &font)
+	// All codepoints of all fonts in the stack
+	Charset GetFullCharsetFilled(const FontStack& fonts)
 	{
 		Charset charset;
 		charset.AddCodepoint(0xFFFF); // Add unknown glyph. It will have index 0.
 
-		FT_UInt nextGlyphIndex;
-		FT_ULong codepoint = FT_Get_First_Char(font.face, &nextGlyphIndex);
-
-		while (nextGlyphIndex != 0)
+		for (size_t font = 0; font < fonts.Size(); ++font)
 		{
-			charset.AddCodepoint(codepoint);
-			codepoint = FT_Get_Next_Char(font.face, codepoint, &nextGlyphIndex);
+			const FT_Face face = fonts.GetFont(font)->face;
+			FT_UInt nextGlyphIndex;
+			FT_ULong codepoint = FT_Get_First_Char(face, &nextGlyphIndex);
+
+			while (nextGlyphIndex != 0)
+			{
+				charset.AddCodepoint(codepoint);
+				codepoint = FT_Get_Next_Char(face, codepoint, &nextGlyphIndex);
+			}
 		}
 
 		return charset;
@@ -379,50 +690,105 @@ namespace
 	}
 } // namespace
 
-	void Atlas::Glyphs::Add( int bitmapX, int bitmapY, const FreeTypeGlyph& ftGlyph )
-	{
-		Glyph glyph {
-			.codepoint = ftGlyph.codepoint,
-			.glyphIndex = ftGlyph.glyphIndex,
-			.x = bitmapX,
-			.y = bitmapY,
-			.width = ftGlyph.Width(),
-			.height = ftGlyph.Height(),
-			.bearingX = (int)(ftGlyph.metrics.horiBearingX / 64),
-			.bearingY = (int)(ftGlyph.metrics.horiBearingY / 64)
-		};
-		m_Glyphs[ftGlyph.glyphIndex] = glyph;
+	void Atlas::Glyphs::Add( int bitmapX, int bitmapY, const FreeTypeGlyph& ftGlyph, unsigned int page )
+	{
+		Glyph glyph = MakeGlyph( ftGlyph.codepoint, ftGlyph.glyphIndex, ftGlyph.Width(), ftGlyph.Height(), ftGlyph.metrics );
+		glyph.x = bitmapX;
+		glyph.y = bitmapY;
+		glyph.page = page;
+		Add( glyph );
+	}
+
+	void Atlas::Glyphs::Add( const Glyph& glyph )
+	{
+		Reserve( glyph.glyphIndex + 1 );
+		if( not Contains( glyph.glyphIndex ) )
+		{
+			++m_Size;
+		}
+		m_Table[glyph.glyphIndex] = glyph;
+	}
+
+	void Atlas::Glyphs::Remove( uint32_t index )
+	{
+		if( Contains( index ) )
+		{
+			m_Table[index].glyphIndex = MissingGlyphIndex;
+			--m_Size;
+		}
+	}
+
+	void Atlas::Glyphs::Reserve( uint32_t glyphCount )
+	{
+		if( glyphCount > m_Table.size() )
+		{
+			Glyph missing {};
+			missing.glyphIndex = MissingGlyphIndex;
+			m_Table.resize( glyphCount, missing );
+		}
 	}
 
 	const Glyph& Atlas::Glyphs::GetGlyphByCodepoint( uint32_t codepoint ) const
 	{
-		return GetGlyphByIndex( m_Font->GetGlyphIndex( codepoint ) );
+		return GetGlyphByIndex( GetGlyphIndex( codepoint ) );
 	}
 
-	const Glyph& Atlas::Glyphs::GetGlyphByIndex( uint32_t index ) const
+	uint32_t Atlas::Glyphs::GetGlyphIndex( uint32_t codepoint ) const
 	{
-		return m_Glyphs.contains( index ) ? m_Glyphs.at( index ) : m_Glyphs.at( m_UnknownGlyphIndex );
+		const uint32_t page = codepoint / CodepointBlockSize;
+		if( page < m_CodepointPages.size() )
+		{
+			const uint32_t glyphIndex = m_CodepointBlocks[ m_CodepointPages[ page ] + codepoint % CodepointBlockSize ];
+			if( glyphIndex != MissingGlyphIndex )
+			{
+				return glyphIndex;
+			}
+		}
+		return m_Fonts->GetGlyphIndex( codepoint );
 	}
-	
-	void Atlas::Glyphs::SetUnknownGlyph( uint32_t codepoint ) const
+
+	void Atlas::Glyphs::MapCodepoint( uint32_t codepoint, uint32_t glyphIndex )
 	{
-		auto index = m_Font->GetGlyphIndex( codepoint );
-		SetUnknownGlyphIndex( index );
+		if( codepoint > MaxCodepoint )
+		{
+			return;
+		}
+		if( m_CodepointPages.empty() )
+		{
+			m_CodepointPages.resize( MaxCodepoint / CodepointBlockSize + 1, 0 );
+			m_CodepointBlocks.resize( CodepointBlockSize, MissingGlyphIndex );
+		}
+
+		uint32_t& block = m_CodepointPages[ codepoint / CodepointBlockSize ];
+		if( block == 0 )
+		{
+			block = static_cast<uint32_t>( m_CodepointBlocks.size() );
+			m_CodepointBlocks.resize( m_CodepointBlocks.size() + CodepointBlockSize, MissingGlyphIndex );
+		}
+		m_CodepointBlocks[ block + codepoint % CodepointBlockSize ] = glyphIndex;
 	}
 
-	const Glyph& Atlas::Glyphs::GetUnknownGlyph() const
+	void Atlas::Glyphs::SetUnknownGlyph( uint32_t codepoint )
 	{
-		return GetGlyphByIndex( m_UnknownGlyphIndex );
+		auto index = GetGlyphIndex( codepoint );
+		SetUnknownGlyphIndex( index );
 	}
 
-	void Atlas::Glyphs::SetUnknownGlyphIndex( uint32_t index ) const
+	void Atlas::Glyphs::SetUnknownGlyphIndex( uint32_t index )
 	{
-		if( m_Glyphs.contains( index ) )
+		if( Contains( index ) )
 		{
 			m_UnknownGlyphIndex = index;
 		}
 	}
 
+	Atlas::Bitmap::Bitmap( unsigned int width, unsigned int height, unsigned int channels, std::span<const uint8_t> data )
+	: m_Data( data.begin(), data.end() ), m_Width( width ), m_Height( height ), m_Channels( channels )
+	{
+		if( m_Data.size() != static_cast<size_t>( width ) * height * channels )
+			throw std::runtime_error( "Error: bitmap data has a wrong size" );
+	}
+
 	Atlas::Bitmap::Bitmap( unsigned int width, unsigned int height, unsigned int channels )
 	: m_Width( width ), m_Height( height ), m_Channels( channels)
 	{
@@ -432,128 +798,645 @@ namespace
 		std::fill(m_Data.begin(), m_Data.end(), fillColor );
 	}
 
-	void DrawRGBA( std::vector<uint8_t>& data, const Atlas::FreeTypeGlyph& glyph, size_t atlasIdx, int glyphX, int glyphY )
+	void Atlas::Bitmap::Grow( unsigned int height )
 	{
-		assert(glyph.Channels() == 4 || glyph.Channels() == 1);
-		uint8_t r = glyph.ColorRed( glyphX, glyphY );
-		uint8_t g = glyph.ColorGreen( glyphX, glyphY );
-		uint8_t b = glyph.ColorBlue( glyphX, glyphY );
-		uint8_t a = glyph.ColorAlpha( glyphX, glyphY );
+		if( height <= m_Height )
+			return;
 
-		if( glyph.Channels() == 1 )
+		// Bitmap rows are stored one after another, so new rows are simply appended
+		uint8_t fillColor = Channels() > 1 ? 0 : 255;
+		m_Data.resize( static_cast<size_t>( m_Width ) * height * m_Channels, fillColor );
+		m_Height = height;
+	}
+
+	void Atlas::Bitmap::Clear( AtlasRegion region )
+	{
+		uint8_t fillColor = Channels() > 1 ? 0 : 255;
+		for( unsigned int row = 0; row < region.height; ++row )
 		{
-			r = 255 - r;
-			g = 255 - g;
-			b = 255 - b;
+			size_t start = ( static_cast<size_t>( region.y + row ) * m_Width + region.x ) * m_Channels;
+			std::fill_n( m_Data.begin() + start, region.width * m_Channels, fillColor );
 		}
+	}
 
-		data[ atlasIdx + 0 ] = r;
-		data[ atlasIdx + 1 ] = g;
-		data[ atlasIdx + 2 ] = b;
-		data[ atlasIdx + 3 ] = a;
+	void Atlas::Bitmap::Draw( int x, int y, const Atlas::FreeTypeGlyph& glyph )
+	{
+		const uint8_t* source = glyph.Data();
+		const ptrdiff_t sourceStride = glyph.Stride();
+		const size_t stride = static_cast<size_t>( Width() ) * Channels();
+		uint8_t* destination = m_Data.data() + static_cast<size_t>( y ) * stride + static_cast<size_t>( x ) * Channels();
+		const size_t width = glyph.Width();
+		const size_t height = glyph.Height();
+
+		// The conversion is chosen once per glyph, the kernels copy whole rows
+		const int glyphChannels = glyph.Channels();
+		if( Channels() == 1 && glyphChannels == 1 )
+			BlitRows<BlitRowGrayInverted>( source, sourceStride, destination, stride, width, height );
+		else if( Channels() == 3 && glyphChannels == 3 )
+			BlitRows<BlitRowRGB>( source, sourceStride, destination, stride, width, height );
+		else if( Channels() == 4 && glyphChannels == 4 )
+			BlitRows<BlitRowBGRAToRGBA>( source, sourceStride, destination, stride, width, height );
+		else if( Channels() == 4 && glyphChannels == 1 )
+			BlitRows<BlitRowGrayToRGBA>( source, sourceStride, destination, stride, width, height );
+		else
+			throw std::runtime_error( "Unsupported number of channels" );
 	}
 
-	void DrawGray( std::vector<uint8_t>& data, const Atlas::FreeTypeGlyph& glyph, size_t atlasIdx, int glyphX, int glyphY )
+	Atlas::Atlas(const std::string& fontPath, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+		: Atlas(FontRegistry::Default().Get(fontPath), fontSize, charset, mode, padding, options)
 	{
-		assert( glyph.Channels() == 1 );
-		uint8_t gray = glyph.ByteAt(glyphX, glyphY);
-		data[atlasIdx] = 255 - gray;
 	}
 
-	void DrawRGB( std::vector<uint8_t>& data, const Atlas::FreeTypeGlyph& glyph, size_t atlasIdx, int glyphX, int glyphY )
+	Atlas::Atlas(std::span<const uint8_t> fontData, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+		: Atlas(FontRegistry::Default().Get(fontData), fontSize, charset, mode, padding, options)
 	{
-		assert( glyph.Channels() == 3 );
-		data[atlasIdx + 0] = glyph.ColorRed(glyphX, glyphY);
-		data[atlasIdx + 1] = glyph.ColorGreen(glyphX, glyphY);
-		data[atlasIdx + 2] = glyph.ColorBlue(glyphX, glyphY);
 	}
 
-	void Atlas::Bitmap::Draw( int x, int y, const Atlas::FreeTypeGlyph& glyph )
+	Atlas::Atlas(std::shared_ptr<Font> font, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+		: Atlas(FontStack(std::move(font)), fontSize, charset, mode, padding, options)
+	{
+	}
+
+	Atlas::Atlas(FontStack fonts, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+		: Atlas(DeferInitialization{}, std::move(fonts), fontSize, charset, mode, padding, options)
+	{
+		InitializeAtlas(charset);
+	}
+
+	Atlas::Atlas(DeferInitialization, FontStack fonts, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+		: m_Fonts(std::make_shared<const FontStack>(std::move(fonts))), m_Glyphs(std::make_shared<Glyphs>(m_Fonts)), m_RenderMode(mode), m_Padding(padding), m_Options(options),
+		m_BuildInputsHash(HashBuildInputs(fontSize, charset, mode, padding, options))
 	{
-		int bitmapWidth = Width();
-		int bitmapChannels = Channels();
+		for (size_t font = 0; font < m_Fonts->Size(); ++font)
+		{
+			m_Fonts->GetFont(font)->SetSize(Pixels{ fontSize });
+		}
+	}
+
+	Atlas Atlas::LoadOrBuild(const std::string& cachePath, const std::string& fontPath, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+	{
+		return LoadOrBuild(cachePath, FontRegistry::Default().Get(fontPath), fontSize, charset, mode, padding, options);
+	}
+
+	Atlas Atlas::LoadOrBuild(const std::string& cachePath, std::span<const uint8_t> fontData, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+	{
+		return LoadOrBuild(cachePath, FontRegistry::Default().Get(fontData), fontSize, charset, mode, padding, options);
+	}
+
+	Atlas Atlas::LoadOrBuild(const std::string& cachePath, std::shared_ptr<Font> font, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+	{
+		return LoadOrBuild(cachePath, FontStack(std::move(font)), fontSize, charset, mode, padding, options);
+	}
+
+	Atlas Atlas::LoadOrBuild(const std::string& cachePath, FontStack fonts, int fontSize, const Charset& charset, RenderMode mode, int padding, const AtlasOptions& options)
+	{
+		Atlas atlas(DeferInitialization{}, std::move(fonts), fontSize, charset, mode, padding, options);
+		return LoadOrBuild(cachePath, std::move(atlas), charset);
+	}
+
+	Atlas Atlas::LoadOrBuild(const std::string& cachePath, Atlas&& atlas, const Charset& charset)
+	{
+		if (atlas.IsDynamic())
+		{
+			throw std::runtime_error("Error: only a static atlas can be cached");
+		}
+
+		std::optional<MappedFile> file;
+		try
+		{
+			file.emplace(cachePath);
+		}
+		catch (const std::runtime_error&)
+		{
+			// The cache was not written yet
+		}
+
+		if (file.has_value() && atlas.LoadCache(file->Data()))
+		{
+			return std::move(atlas);
+		}
+		file.reset(); // A mapped file cannot be replaced on Windows
+
+		atlas.InitializeAtlas(charset);
+		atlas.SaveCache(cachePath);
+		return std::move(atlas);
+	}
 
-		unsigned int glyphHeight = glyph.Height();
-		unsigned int glyphWidth = glyph.Width();
-		int glyphChannels = glyph.Channels();
+	uint64_t Atlas::GetCacheKey() const
+	{
+		uint64_t hash = m_BuildInputsHash;
+		for (size_t font = 0; font < m_Fonts->Size(); ++font)
+		{
+			hash = HashValue(m_Fonts->GetFont(font)->GetContentHash(), hash);
+		}
+		return hash;
+	}
+
+	/**
+	* The cache file is the header, the codepoint table, the glyph table and all bitmap pages stored
+	* one after another exactly as they are in memory. The codepoint table keeps every codepoint of
+	* the charset, including aliases of glyphs loaded for another codepoint.
+	* Loading copies each table and page at once and only validates them. Glyphs and bitmaps own
+	* their memory, so they are not served from the mapping.
+	*/
+	void Atlas::SaveCache(const std::string& path) const
+	{
+		if (IsDynamic())
+		{
+			throw std::runtime_error("Error: only a static atlas can be cached");
+		}
 
-		// Copy glyph bitmap to atlas bitmap
-		for( unsigned int glyphY = 0; glyphY < glyphHeight; ++glyphY )
+		const Bitmap& firstPage = m_Bitmaps.front();
+		CacheHeader header{};
+		std::copy(std::begin(CacheMagic), std::end(CacheMagic), header.magic);
+		header.version = CacheVersion;
+		header.glyphSize = sizeof(Glyph);
+		header.tableSize = static_cast<uint32_t>(m_Glyphs->m_Table.size());
+		header.inputHash = GetCacheKey();
+		header.unknownGlyphIndex = m_Glyphs->m_UnknownGlyphIndex;
+		header.codepointPageCount = static_cast<uint32_t>(m_Glyphs->m_CodepointPages.size());
+		header.codepointBlockCount = static_cast<uint32_t>(m_Glyphs->m_CodepointBlocks.size());
+		header.pageCount = static_cast<uint32_t>(m_Bitmaps.size());
+		header.pageWidth = firstPage.Width();
+		header.pageHeight = firstPage.Height();
+		header.channels = firstPage.Channels();
+		header.metrics = m_Fonts->GetPrimaryFont()->GetMetrics();
+
+		// Write to a temporary file first, so other processes never map a partially written cache
+		const std::string temporaryPath = path + ".tmp";
 		{
-			unsigned int atlasBitmapRow = (y + glyphY) * bitmapWidth * bitmapChannels;
-			for( unsigned int glyphX = 0; glyphX < glyphWidth; ++glyphX )
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (not file)
+			{
+				throw std::runtime_error("Error: could not write the cache file");
+			}
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			WriteArray(file, m_Glyphs->m_CodepointPages);
+			WriteArray(file, m_Glyphs->m_CodepointBlocks);
+			WriteArray(file, m_Glyphs->m_Table);
+			for (const Bitmap& bitmap : m_Bitmaps)
 			{
-				unsigned int atlasBitmapIndex = atlasBitmapRow + x * bitmapChannels + glyphX * bitmapChannels;
-				switch( bitmapChannels )
+				WriteArray(file, bitmap.Data());
+			}
+
+			if (not file)
+			{
+				throw std::runtime_error("Error: could not write the cache file");
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temporaryPath, error);
+			throw std::runtime_error("Error: could not write the cache file");
+		}
+	}
+
+	/**
+	* Returns false when the data is not a valid cache of this atlas.
+	* In such case the atlas is left unchanged.
+	*/
+	bool Atlas::LoadCache(std::span<const uint8_t> data)
+	{
+		CacheHeader header;
+		if (data.size() < sizeof(header))
+		{
+			return false;
+		}
+		std::memcpy(&header, data.data(), sizeof(header));
+
+		const bool isCompatible = std::equal(std::begin(CacheMagic), std::end(CacheMagic), header.magic)
+			&& header.version == CacheVersion
+			&& header.glyphSize == sizeof(Glyph)
+			&& header.channels == static_cast<uint32_t>(GetChannels(m_RenderMode));
+		if (not isCompatible || header.inputHash != GetCacheKey() || header.metrics != m_Fonts->GetPrimaryFont()->GetMetrics())
+		{
+			return false;
+		}
+
+		const size_t codepointTableSize = (static_cast<size_t>(header.codepointPageCount) + header.codepointBlockCount) * sizeof(uint32_t);
+		const size_t glyphsSize = static_cast<size_t>(header.tableSize) * sizeof(Glyph);
+		const size_t pageSize = static_cast<size_t>(header.pageWidth) * header.pageHeight * header.channels;
+		if (data.size() != sizeof(header) + codepointTableSize + glyphsSize + pageSize * header.pageCount
+			|| header.pageCount == 0 || header.tableSize > m_Fonts->GlyphCount()
+			|| (header.codepointPageCount != 0 && header.codepointPageCount != MaxCodepoint / CodepointBlockSize + 1))
+		{
+			return false;
+		}
+
+		Glyphs glyphs(m_Fonts);
+		const uint8_t* cacheData = data.data() + sizeof(header);
+		glyphs.m_CodepointPages = ReadArray<uint32_t>(cacheData, header.codepointPageCount);
+		glyphs.m_CodepointBlocks = ReadArray<uint32_t>(cacheData, header.codepointBlockCount);
+		glyphs.m_Table = ReadArray<Glyph>(cacheData, header.tableSize);
+
+		for (uint32_t index = 0; index < header.tableSize; ++index)
+		{
+			const Glyph& glyph = glyphs.m_Table[index];
+			if (not Glyphs::IsPresent(glyph))
+			{
+				continue;
+			}
+			if (glyph.glyphIndex != index || not IsInsidePages(glyph, header))
+			{
+				return false;
+			}
+			++glyphs.m_Size;
+		}
+		const auto isBlockOutside = [&](uint32_t block) {
+			return static_cast<uint64_t>(block) + CodepointBlockSize > header.codepointBlockCount;
+		};
+		const auto isInvalidGlyphIndex = [&](uint32_t glyphIndex) {
+			return glyphIndex != Glyphs::MissingGlyphIndex && glyphIndex >= m_Fonts->GlyphCount();
+		};
+		if (std::ranges::any_of(glyphs.m_CodepointPages, isBlockOutside) || std::ranges::any_of(glyphs.m_CodepointBlocks, isInvalidGlyphIndex))
+		{
+			return false;
+		}
+		if (not glyphs.Contains(header.unknownGlyphIndex))
+		{
+			return false;
+		}
+		glyphs.m_UnknownGlyphIndex = header.unknownGlyphIndex;
+
+		std::vector<Bitmap> bitmaps;
+		bitmaps.reserve(header.pageCount);
+		for (uint32_t page = 0; page < header.pageCount; ++page)
+		{
+			bitmaps.emplace_back(header.pageWidth, header.pageHeight, header.channels, std::span{ cacheData + page * pageSize, pageSize });
+		}
+
+		m_Glyphs = std::make_shared<Glyphs>(std::move(glyphs));
+		m_Bitmaps = std::move(bitmaps);
+		return true;
+	}
+
+	void Atlas::InitializeAtlas(const Trex::Charset& charset)
+	{
+		// Faces may be shared with atlases of other sizes and threads. Workers rasterize with their own
+		// clones, so the faces are locked only while they are used directly.
+		auto fontLocks = m_Fonts->LockFaces();
+		Charset filledCharset = charset.IsFull() ? GetFullCharsetFilled(*m_Fonts) : charset;
+		if (IsDynamic())
+		{
+			filledCharset.AddCodepoint(0xFFFF); // Unknown glyph is needed before any glyph is missing
+			// References to glyphs stay valid when more glyphs are loaded, as long as the table is not shared
+			MutableGlyphs().Reserve(m_Fonts->GlyphCount());
+		}
+
+		const auto glyphsToLoad = GetUniqueGlyphs(*m_Fonts, filledCharset, *m_Glyphs);
+		const FontFaces faces = GetFaces(*m_Fonts);
+		std::vector<Font> workerFonts; // Must outlive the glyphs rasterized by workers
+		std::vector<FontFaces> workerFaces;
+		const unsigned int workers = GetWorkerCount(m_Options.threads, glyphsToLoad.size());
+		if (workers > 1)
+		{
+			fontLocks.clear();
+			workerFonts.reserve(static_cast<size_t>(workers) * m_Fonts->Size());
+			for (unsigned int i = 0; i < workers; ++i)
+			{
+				FontFaces& workerFace = workerFaces.emplace_back();
+				for (size_t font = 0; font < m_Fonts->Size(); ++font)
 				{
-					case 1:
-						DrawGray(m_Data, glyph, atlasBitmapIndex, glyphX, glyphY);
-						break;
-					case 3:
-						DrawRGB(m_Data, glyph, atlasBitmapIndex, glyphX, glyphY);
-						break;
-					case 4:
-						DrawRGBA(m_Data, glyph, atlasBitmapIndex, glyphX, glyphY);
-						break;
-					default:
-						throw std::runtime_error("Unsupported number of channels");
+					workerFace.push_back(workerFonts.emplace_back(m_Fonts->GetFont(font)->Clone()).face);
 				}
 			}
 		}
+
+		if (m_Options.streamingBuild)
+		{
+			// Only the final bitmap and glyph metrics are kept in memory
+			std::vector<Glyph> glyphs = MeasureAllGlyphs(faces, workerFaces, glyphsToLoad, m_RenderMode);
+			const AtlasLayout layout = PackGlyphs(GetPackerRects(glyphs, m_Padding));
+			m_Bitmaps = CreateAtlasBitmaps(layout, GetChannels(m_RenderMode));
+			RenderAllGlyphs(faces, workerFaces, glyphsToLoad, glyphs, m_Bitmaps, layout, m_Padding, m_RenderMode);
+			for (const Glyph& glyph : glyphs)
+			{
+				MutableGlyphs().Add(glyph);
+			}
+		}
+		else
+		{
+			const auto ftGlyphs = LoadAllGlyphs(faces, workerFaces, glyphsToLoad, m_RenderMode);
+
+			// Glyphs with identical bitmaps are packed once
+			const auto bitmapSources = m_Options.deduplicateBitmaps ? FindIdenticalBitmaps(ftGlyphs) : std::vector<size_t>{};
+			AtlasLayout layout = PackGlyphs(GetPackerRects(ftGlyphs, m_Padding, bitmapSources));
+			if (not bitmapSources.empty())
+			{
+				layout = ShareIdenticalBitmaps(std::move(layout), bitmapSources);
+			}
+
+			m_Bitmaps = BuildAtlasBitmaps( *m_Glyphs, ftGlyphs, layout, m_Padding, GetChannels(m_RenderMode), bitmapSources );
+		}
+
+		InitializeDefaultGlyphIndex();
 	}
 
-	Atlas::Atlas(const std::string& fontPath, int fontSize, const Charset& charset, RenderMode mode, int padding)
-		: m_Font(std::make_shared<Font>(fontPath.c_str())), m_Glyphs(m_Font)
+	AtlasLayout Atlas::PackGlyphs(const std::vector<PackerRect>& rects)
 	{
-		m_Font->SetSize(Pixels{ fontSize });
-		InitializeAtlas(charset, mode, padding);
+		AtlasLayout layout;
+		if (IsDynamic())
+		{
+			// The packers are kept, so the free space can be used for glyphs added later
+			const unsigned int pageSizeLimit = GetPageSizeLimit(m_Options.maxPageSize, m_Options.size);
+			const unsigned int width = m_Options.width != 0 ? m_Options.width : GetMinAtlasWidth(rects, m_Options.size);
+			m_Packers = { CreatePagePacker(std::min(width, pageSizeLimit)) };
+
+			layout.positions.resize(rects.size());
+			layout.pages.resize(rects.size());
+			for (size_t index : GetPackingOrder(m_Options.packing, rects))
+			{
+				auto allocation = InsertIntoPages(rects[index]);
+				if (not allocation.has_value())
+				{
+					throw std::runtime_error("Error: glyphs do not fit into the atlas");
+				}
+				std::tie(layout.pages[index], layout.positions[index]) = *allocation;
+			}
+
+			unsigned int usedHeight = 0;
+			for (const auto& packer : m_Packers)
+			{
+				usedHeight = std::max(usedHeight, packer->UsedHeight());
+			}
+			const RectPacker& firstPage = *m_Packers.front();
+			layout.width = firstPage.Width();
+			layout.height = IsCache() // Size of a cache never changes
+				? firstPage.Height()
+				: std::min(GetAtlasHeight(usedHeight, layout.width, m_Options.size), firstPage.Height());
+			layout.pageCount = static_cast<unsigned int>(m_Packers.size());
+		}
+		else
+		{
+			layout = PackAtlasPages(m_Options.packing, rects, m_Options.size, m_Options.maxPageSize);
+		}
+
+		return layout;
 	}
 
-	Atlas::Atlas(std::span<const uint8_t> fontData, int fontSize, const Charset& charset, RenderMode mode, int padding)
-		: m_Font(std::make_shared<Font>(fontData)), m_Glyphs(m_Font)
+	void Atlas::InitializeDefaultGlyphIndex()
 	{
-		m_Font->SetSize(Pixels{ fontSize });
-		InitializeAtlas(charset, mode, padding);
+		if (m_Glyphs->Empty())
+		{
+			throw std::runtime_error("Error: cannot set default glyph in empty atlas");
+		}
+
+		Glyphs& glyphs = MutableGlyphs();
+		glyphs.SetUnknownGlyphIndex(glyphs.Data().front().glyphIndex); // Set first glyph as default
+		glyphs.SetUnknownGlyphIndex(0); // Try to set 'undefined character code' as default
+		glyphs.SetUnknownGlyph(0xFFFD); // Try to set 'unicode replacement character' as default
 	}
 
-	void Atlas::InitializeAtlas(const Trex::Charset& charset, Trex::RenderMode mode, int padding)
+	void Atlas::SetUnknownGlyph(uint32_t codepoint)
 	{
-		const Charset filledCharset = charset.IsFull() ? GetFullCharsetFilled(*m_Font) : charset;
+		if (m_Glyphs->Contains(m_Glyphs->GetGlyphIndex(codepoint)))
+		{
+			MutableGlyphs().SetUnknownGlyph(codepoint);
+		}
+	}
 
-		auto ftGlyphs = LoadAllGlyphs(m_Font->face, filledCharset, mode);
-		auto atlasSize = GetAtlasSize( ftGlyphs, padding);
+	Glyph Atlas::LoadGlyphByIndex(uint32_t glyphIndex)
+	{
+		if (IsDynamic() && not m_Glyphs->Contains(glyphIndex) && glyphIndex < m_Fonts->GlyphCount())
+		{
+			AddGlyph(0, glyphIndex); // Codepoint of a shaped glyph is unknown
+		}
+		TouchGlyph(glyphIndex);
+		return m_Glyphs->GetGlyphByIndex(glyphIndex);
+	}
 
-		auto bitmap = BuildAtlasBitmap( m_Glyphs, ftGlyphs, atlasSize, padding, GetChannels(mode) );
-		this->m_Bitmap = std::move(bitmap);
+	Glyph Atlas::LoadGlyphByCodepoint(uint32_t codepoint)
+	{
+		const uint32_t glyphIndex = m_Glyphs->GetGlyphIndex(codepoint);
+		if (IsDynamic() && not m_Glyphs->Contains(glyphIndex) && glyphIndex != 0)
+		{
+			MutableGlyphs().MapCodepoint(codepoint, glyphIndex); // Next loads of the codepoint skip FreeType
+			AddGlyph(codepoint, glyphIndex);
+		}
+		TouchGlyph(glyphIndex);
+		return m_Glyphs->GetGlyphByIndex(glyphIndex);
+	}
 
-		InitializeDefaultGlyphIndex();
+	std::vector<AtlasRegion> Atlas::TakeDirtyRegions()
+	{
+		return std::exchange(m_DirtyRegions, {});
 	}
 
-	void Atlas::InitializeDefaultGlyphIndex()
+	std::shared_ptr<RectPacker> Atlas::CreatePagePacker(unsigned int width) const
 	{
-		if (m_Glyphs.Empty())
+		const unsigned int pageSizeLimit = GetPageSizeLimit(m_Options.maxPageSize, m_Options.size);
+		if (IsCache())
 		{
-			throw std::runtime_error("Error: cannot set default glyph in empty atlas");
+			const unsigned int height = m_Options.height != 0 ? m_Options.height : width;
+			return std::make_shared<ShelfAllocator>(width, std::min(height, pageSizeLimit));
+		}
+		return CreatePacker(m_Options.packing, width, pageSizeLimit);
+	}
+
+	/**
+	* Place a rectangle on the first page with enough space.
+	* When all pages are full and the page size is limited, a new page is added to a dynamic atlas.
+	*/
+	std::optional<std::pair<unsigned int, PackerPosition>> Atlas::InsertIntoPages(PackerRect rect)
+	{
+		for (size_t page = 0; page < m_Packers.size(); ++page)
+		{
+			auto& packer = m_Packers[page];
+			if (packer.use_count() > 1)
+			{
+				packer = packer->Clone(); // The packer is shared with a copy of this atlas
+			}
+			if (auto position = packer->Insert(rect))
+			{
+				return std::pair{ static_cast<unsigned int>(page), *position };
+			}
+		}
+
+		const bool canAddPage = not IsCache() && m_Options.maxPageSize != 0;
+		if (not canAddPage)
+		{
+			return std::nullopt;
+		}
+
+		auto packer = CreatePagePacker(m_Packers.front()->Width());
+		auto position = packer->Insert(rect);
+		if (not position.has_value())
+		{
+			return std::nullopt; // Rectangle is larger than a whole page
+		}
+		m_Packers.push_back(std::move(packer));
+		return std::pair{ static_cast<unsigned int>(m_Packers.size() - 1), *position };
+	}
+
+	void Atlas::GrowPage(unsigned int page)
+	{
+		if (page == m_Bitmaps.size())
+		{
+			m_Bitmaps.emplace_back(m_Packers[page]->Width(), 0, GetChannels(m_RenderMode));
+		}
+
+		Bitmap& bitmap = m_Bitmaps[page];
+		const RectPacker& packer = *m_Packers[page];
+		if (packer.UsedHeight() > bitmap.Height())
+		{
+			const unsigned int neededHeight = GetAtlasHeight(packer.UsedHeight(), bitmap.Width(), m_Options.size);
+			bitmap.Grow(std::min(std::max(neededHeight, bitmap.Height() * 2), packer.Height()));
+			MarkDirty({ 0, 0, bitmap.Width(), bitmap.Height(), page });
+		}
+	}
+
+	void Atlas::AddGlyph(uint32_t codepoint, uint32_t glyphIndex)
+	{
+		const GlyphToLoad glyph = MakeGlyphToLoad(*m_Fonts, codepoint, glyphIndex);
+		const Font& font = *m_Fonts->GetFont(glyph.font);
+		const auto fontLock = font.LockFace();
+		FreeTypeGlyph ftGlyph = LoadGlyph(font.face, glyph, m_RenderMode);
+		const PackerRect rect{ ftGlyph.Width() + m_Padding * 2, ftGlyph.Height() + m_Padding * 2 };
+
+		auto allocation = InsertIntoPages(rect);
+		const bool canEvict = IsCache() && not allocation.has_value() && CanFitAfterEviction(rect);
+		while (canEvict && not allocation.has_value() && EvictLeastRecentlyUsedGlyph())
+		{
+			allocation = InsertIntoPages(rect);
+		}
+		if (not allocation.has_value())
+		{
+			return; // Glyph is wider than the atlas or larger than the whole cache
+		}
+
+		const auto [page, position] = *allocation;
+		GrowPage(page);
+
+		const int glyphX = position.x + m_Padding;
+		const int glyphY = position.y + m_Padding;
+		m_Bitmaps[page].Draw(glyphX, glyphY, ftGlyph);
+		MutableGlyphs().Add(glyphX, glyphY, ftGlyph, page);
+		MarkDirty({ glyphX, glyphY, ftGlyph.Width(), ftGlyph.Height(), page });
+
+		if (IsCache())
+		{
+			m_GlyphLastUse[glyphIndex] = ++m_UseCounter;
+		}
+	}
+
+	Atlas::Glyphs& Atlas::MutableGlyphs()
+	{
+		if (m_Glyphs.use_count() > 1)
+		{
+			m_Glyphs = std::make_shared<Glyphs>(*m_Glyphs); // The table is shared with a shaper or a copy of this atlas
+		}
+		return *m_Glyphs;
+	}
+
+	void Atlas::TouchGlyph(uint32_t glyphIndex)
+	{
+		if (not IsCache())
+		{
+			return;
+		}
+
+		auto lastUse = m_GlyphLastUse.find(glyphIndex);
+		if (lastUse != m_GlyphLastUse.end())
+		{
+			lastUse->second = ++m_UseCounter;
 		}
+	}
 
-		m_Glyphs.SetUnknownGlyphIndex(m_Glyphs.Data().begin()->first); // Set first glyph as default
-		m_Glyphs.SetUnknownGlyphIndex(0); // Try to set 'undefined character code' as default
-		m_Glyphs.SetUnknownGlyph(0xFFFD); // Try to set 'unicode replacement character' as default
+	/**
+	* Evicting glyphs only helps when the rectangle fits into a page and into the space
+	* not pinned by the initial charset. Otherwise a glyph that can never be added would
+	* evict every cached glyph first.
+	*/
+	bool Atlas::CanFitAfterEviction(PackerRect rect) const
+	{
+		const RectPacker& page = *m_Packers.front(); // A cache has a single page
+		if (rect.width > page.Width() || rect.height > page.Height())
+		{
+			return false;
+		}
+
+		uint64_t pinnedArea = 0;
+		for (const Glyph& glyph : m_Glyphs->Data())
+		{
+			if (not m_GlyphLastUse.contains(glyph.glyphIndex))
+			{
+				pinnedArea += static_cast<uint64_t>(glyph.width + m_Padding * 2) * (glyph.height + m_Padding * 2);
+			}
+		}
+		const uint64_t pageArea = static_cast<uint64_t>(page.Width()) * page.Height();
+		return pinnedArea < pageArea && static_cast<uint64_t>(rect.width) * rect.height <= pageArea - pinnedArea;
+	}
+
+	/**
+	* Finding the oldest glyph is linear, but it only happens when the cache is full
+	* and a glyph has to be rasterized anyway. Marking a glyph as used stays cheap.
+	*/
+	bool Atlas::EvictLeastRecentlyUsedGlyph()
+	{
+		if (m_GlyphLastUse.empty())
+		{
+			return false;
+		}
+
+		auto oldest = std::min_element(m_GlyphLastUse.begin(), m_GlyphLastUse.end(),
+			[](const auto& a, const auto& b) { return a.second < b.second; });
+		const uint32_t glyphIndex = oldest->first;
+		m_GlyphLastUse.erase(oldest);
+
+		const Glyph glyph = m_Glyphs->GetGlyphByIndex(glyphIndex);
+		const AtlasRegion paddedRegion{
+			glyph.x - m_Padding, glyph.y - m_Padding, glyph.width + m_Padding * 2, glyph.height + m_Padding * 2 };
+		auto& packer = m_Packers[glyph.page];
+		if (packer.use_count() > 1)
+		{
+			packer = packer->Clone(); // The packer is shared with a copy of this atlas
+		}
+		packer->Remove({ paddedRegion.x, paddedRegion.y }, { paddedRegion.width, paddedRegion.height });
+		MutableGlyphs().Remove(glyphIndex);
+
+		// Clear the pixels, so the old glyph does not bleed into the padding of a new one
+		m_Bitmaps[glyph.page].Clear(paddedRegion);
+		MarkDirty({ glyph.x, glyph.y, glyph.width, glyph.height, glyph.page });
+		return true;
+	}
+
+	void Atlas::MarkDirty(AtlasRegion region)
+	{
+		const Bitmap& bitmap = m_Bitmaps[region.page];
+		const AtlasRegion wholePage{ 0, 0, bitmap.Width(), bitmap.Height(), region.page };
+		if (region == wholePage)
+		{
+			std::erase_if(m_DirtyRegions, [&](const AtlasRegion& dirty) { return dirty.page == region.page; });
+			m_DirtyRegions.push_back(wholePage);
+			return;
+		}
+
+		const bool isEmpty = region.width == 0 || region.height == 0;
+		const bool isCovered = std::ranges::find(m_DirtyRegions, wholePage) != m_DirtyRegions.end();
+		if (not isEmpty && not isCovered)
+		{
+			m_DirtyRegions.push_back(region);
+		}
 	}
 
-	void Atlas::SaveToFile(const std::string& path) const
+	void Atlas::SaveToFile(const std::string& path, unsigned int page) const
 	{
-		const int channels = m_Bitmap.Channels();
-		const int width = static_cast<int>(m_Bitmap.Width());
-		const int height = static_cast<int>(m_Bitmap.Height());
+		const Bitmap& bitmap = m_Bitmaps.at(page);
+		const int channels = bitmap.Channels();
+		const int width = static_cast<int>(bitmap.Width());
+		const int height = static_cast<int>(bitmap.Height());
 
 		if (path.ends_with(".png"))
 		{
-			stbi_write_png(path.c_str(), width, height, channels, m_Bitmap.Data().data(), 0);
+			stbi_write_png(path.c_str(), width, height, channels, bitmap.Data().data(), 0);
 		}
 		else if (path.ends_with(".bmp"))
 		{
-			stbi_write_bmp(path.c_str(), width, height, channels, m_Bitmap.Data().data());
+			stbi_write_bmp(path.c_str(), width, height, channels, bitmap.Data().data());
 		}
 		else
 		{
@@ -1,40 +1,167 @@
 #include "Trex/BitmapHelpers.hpp"
+#include "Simd.hpp"
+#include <stdexcept>
 
 namespace Trex
 {
+	namespace
+	{
+		/**
+		 * Throw if the output buffer cannot hold the converted bitmap.
+		 */
+		void CheckOutputSize(std::span<const uint8_t> input, std::span<uint8_t> output, size_t channels)
+		{
+			if (output.size() < input.size() * channels)
+				throw std::runtime_error("Error: output buffer is too small for the converted bitmap");
+		}
+	}
+
 	std::vector<uint8_t> ConvertBitmapToGrayAlpha(const std::span<const uint8_t> input)
 	{
 		std::vector<uint8_t> output(input.size() * 2);
-		for (size_t i = 0; i < input.size(); i++)
+		ConvertBitmapToGrayAlpha(input, output);
+		return output;
+	}
+
+	void ConvertBitmapToGrayAlpha(const std::span<const uint8_t> input, const std::span<uint8_t> output)
+	{
+		CheckOutputSize(input, output, 2);
+		const uint8_t* source = input.data();
+		uint8_t* destination = output.data();
+		size_t i = 0;
+#if defined(TREX_AVX2)
+		// Each 128-bit lane expands a half of the 16 loaded pixels
+		const __m256i pairs = _mm256_setr_epi8(
+			0, -1, 1, -1, 2, -1, 3, -1, 4, -1, 5, -1, 6, -1, 7, -1,
+			8, -1, 9, -1, 10, -1, 11, -1, 12, -1, 13, -1, 14, -1, 15, -1);
+		const __m256i alpha = _mm256_set1_epi16(static_cast<short>(0xFF00));
+		for (; i + 16 <= input.size(); i += 16)
 		{
-			output[i * 2] = input[i];
-			output[i * 2 + 1] = 255;
+			__m256i gray = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+			__m256i grayAlpha = _mm256_or_si256(_mm256_shuffle_epi8(gray, pairs), alpha);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i * 2), grayAlpha);
+		}
+#elif defined(TREX_SSE2)
+		const __m128i alpha = _mm_set1_epi8(-1);
+		for (; i + 16 <= input.size(); i += 16)
+		{
+			__m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+			__m128i* grayAlpha = reinterpret_cast<__m128i*>(destination + i * 2);
+			_mm_storeu_si128(grayAlpha + 0, _mm_unpacklo_epi8(gray, alpha));
+			_mm_storeu_si128(grayAlpha + 1, _mm_unpackhi_epi8(gray, alpha));
+		}
+#elif defined(TREX_NEON)
+		const uint8x16_t alpha = vdupq_n_u8(255);
+		for (; i + 16 <= input.size(); i += 16)
+			vst2q_u8(destination + i * 2, uint8x16x2_t { { vld1q_u8(source + i), alpha } });
+#endif
+		for (; i < input.size(); i++)
+		{
+			destination[i * 2] = source[i];
+			destination[i * 2 + 1] = 255;
 		}
-		return output;
 	}
 
 	std::vector<uint8_t> ConvertBitmapToRGB(const std::span<const uint8_t> input)
 	{
 		std::vector<uint8_t> output(input.size() * 3);
-		for (size_t i = 0; i < input.size(); i++)
+		ConvertBitmapToRGB(input, output);
+		return output;
+	}
+
+	void ConvertBitmapToRGB(const std::span<const uint8_t> input, const std::span<uint8_t> output)
+	{
+		CheckOutputSize(input, output, 3);
+		const uint8_t* source = input.data();
+		uint8_t* destination = output.data();
+		size_t i = 0;
+#if defined(TREX_SSSE3)
+		// 16 pixels are expanded into three 16-byte blocks of RGB triplets
+		const __m128i first = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+		const __m128i second = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+		const __m128i third = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+		for (; i + 16 <= input.size(); i += 16)
 		{
-			output[i * 3] = input[i];
-			output[i * 3 + 1] = input[i];
-			output[i * 3 + 2] = input[i];
+			__m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+			__m128i* rgb = reinterpret_cast<__m128i*>(destination + i * 3);
+			_mm_storeu_si128(rgb + 0, _mm_shuffle_epi8(gray, first));
+			_mm_storeu_si128(rgb + 1, _mm_shuffle_epi8(gray, second));
+			_mm_storeu_si128(rgb + 2, _mm_shuffle_epi8(gray, third));
+		}
+#elif defined(TREX_NEON)
+		for (; i + 16 <= input.size(); i += 16)
+		{
+			uint8x16_t gray = vld1q_u8(source + i);
+			vst3q_u8(destination + i * 3, uint8x16x3_t { { gray, gray, gray } });
+		}
+#endif
+		for (; i < input.size(); i++)
+		{
+			destination[i * 3] = source[i];
+			destination[i * 3 + 1] = source[i];
+			destination[i * 3 + 2] = source[i];
 		}
-		return output;
 	}
 
 	std::vector<uint8_t> ConvertBitmapToRGBA(const std::span<const uint8_t> input)
 	{
 		std::vector<uint8_t> output(input.size() * 4);
-		for (size_t i = 0; i < input.size(); i++)
+		ConvertBitmapToRGBA(input, output);
+		return output;
+	}
+
+	void ConvertBitmapToRGBA(const std::span<const uint8_t> input, const std::span<uint8_t> output)
+	{
+		CheckOutputSize(input, output, 4);
+		const uint8_t* source = input.data();
+		uint8_t* destination = output.data();
+		size_t i = 0;
+#if defined(TREX_AVX2)
+		// Each 128-bit lane expands a quarter of the 16 loaded pixels
+		const __m256i lowPixels = _mm256_setr_epi8(
+			0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1,
+			4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1);
+		const __m256i highPixels = _mm256_setr_epi8(
+			8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1,
+			12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1);
+		const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+		for (; i + 16 <= input.size(); i += 16)
 		{
-			output[i * 4] = input[i];
-			output[i * 4 + 1] = input[i];
-			output[i * 4 + 2] = input[i];
-			output[i * 4 + 3] = 255;
+			__m256i gray = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+			__m256i* rgba = reinterpret_cast<__m256i*>(destination + i * 4);
+			_mm256_storeu_si256(rgba + 0, _mm256_or_si256(_mm256_shuffle_epi8(gray, lowPixels), alpha));
+			_mm256_storeu_si256(rgba + 1, _mm256_or_si256(_mm256_shuffle_epi8(gray, highPixels), alpha));
+		}
+#elif defined(TREX_SSE2)
+		const __m128i alpha = _mm_set1_epi8(-1);
+		for (; i + 16 <= input.size(); i += 16)
+		{
+			__m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+			// Interleave to (gray, gray) and (gray, alpha) pairs, then the pairs to whole pixels
+			__m128i grayGrayLow = _mm_unpacklo_epi8(gray, gray);
+			__m128i grayGrayHigh = _mm_unpackhi_epi8(gray, gray);
+			__m128i grayAlphaLow = _mm_unpacklo_epi8(gray, alpha);
+			__m128i grayAlphaHigh = _mm_unpackhi_epi8(gray, alpha);
+			__m128i* rgba = reinterpret_cast<__m128i*>(destination + i * 4);
+			_mm_storeu_si128(rgba + 0, _mm_unpacklo_epi16(grayGrayLow, grayAlphaLow));
+			_mm_storeu_si128(rgba + 1, _mm_unpackhi_epi16(grayGrayLow, grayAlphaLow));
+			_mm_storeu_si128(rgba + 2, _mm_unpacklo_epi16(grayGrayHigh, grayAlphaHigh));
+			_mm_storeu_si128(rgba + 3, _mm_unpackhi_epi16(grayGrayHigh, grayAlphaHigh));
+		}
+#elif defined(TREX_NEON)
+		const uint8x16_t alpha = vdupq_n_u8(255);
+		for (; i + 16 <= input.size(); i += 16)
+		{
+			uint8x16_t gray = vld1q_u8(source + i);
+			vst4q_u8(destination + i * 4, uint8x16x4_t { { gray, gray, gray, alpha } });
+		}
+#endif
+		for (; i < input.size(); i++)
+		{
+			destination[i * 4] = source[i];
+			destination[i * 4 + 1] = source[i];
+			destination[i * 4 + 2] = source[i];
+			destination[i * 4 + 3] = 255;
 		}
-		return output;
 	}
-}
\ No newline at end of file
+}
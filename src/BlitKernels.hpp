@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "Simd.hpp"
+
+// Row kernels that copy glyph pixels into an atlas bitmap.
+// Every kernel converts `width` pixels starting at `source` and writes them to `destination`.
+namespace Trex
+{
+	// Grayscale glyph into a grayscale atlas, which stores inverted coverage (255 is empty).
+	inline void BlitRowGrayInverted( const uint8_t* source, uint8_t* destination, size_t width )
+	{
+		size_t x = 0;
+#if defined(TREX_SSE2)
+		const __m128i ones = _mm_set1_epi8( -1 );
+		for( ; x + 16 <= width; x += 16 )
+		{
+			__m128i gray = _mm_loadu_si128( reinterpret_cast<const __m128i*>( source + x ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( destination + x ), _mm_xor_si128( gray, ones ) );
+		}
+#elif defined(TREX_NEON)
+		for( ; x + 16 <= width; x += 16 )
+			vst1q_u8( destination + x, vmvnq_u8( vld1q_u8( source + x ) ) );
+#endif
+		for( ; x < width; ++x )
+			destination[x] = 255 - source[x];
+	}
+
+	// LCD glyph into an RGB atlas. Both store the subpixels in the same order.
+	inline void BlitRowRGB( const uint8_t* source, uint8_t* destination, size_t width )
+	{
+		std::memcpy( destination, source, width * 3 );
+	}
+
+	// Color glyph (BGRA) into an RGBA atlas.
+	inline void BlitRowBGRAToRGBA( const uint8_t* source, uint8_t* destination, size_t width )
+	{
+		size_t x = 0;
+#if defined(TREX_SSE2)
+		// Pixels are read as little-endian 32-bit words, so blue is the lowest byte and red the third one
+		const __m128i greenAlphaMask = _mm_set1_epi32( static_cast<int>( 0xFF00FF00 ) );
+		const __m128i blueRedMask = _mm_set1_epi32( 0x00FF00FF );
+		for( ; x + 4 <= width; x += 4 )
+		{
+			__m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>( source + x * 4 ) );
+			__m128i greenAlpha = _mm_and_si128( pixels, greenAlphaMask );
+			__m128i blueRed = _mm_and_si128( pixels, blueRedMask );
+			__m128i redBlue = _mm_or_si128( _mm_slli_epi32( blueRed, 16 ), _mm_srli_epi32( blueRed, 16 ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( destination + x * 4 ), _mm_or_si128( greenAlpha, redBlue ) );
+		}
+#elif defined(TREX_NEON)
+		for( ; x + 16 <= width; x += 16 )
+		{
+			uint8x16x4_t pixels = vld4q_u8( source + x * 4 );
+			uint8x16_t blue = pixels.val[0];
+			pixels.val[0] = pixels.val[2];
+			pixels.val[2] = blue;
+			vst4q_u8( destination + x * 4, pixels );
+		}
+#endif
+		for( ; x < width; ++x )
+		{
+			const uint8_t* bgra = source + x * 4;
+			uint8_t* rgba = destination + x * 4;
+			rgba[0] = bgra[2];
+			rgba[1] = bgra[1];
+			rgba[2] = bgra[0];
+			rgba[3] = bgra[3];
+		}
+	}
+
+	// Grayscale glyph into an RGBA atlas: inverted coverage as the color and coverage as the alpha.
+	inline void BlitRowGrayToRGBA( const uint8_t* source, uint8_t* destination, size_t width )
+	{
+		size_t x = 0;
+#if defined(TREX_SSE2)
+		const __m128i ones = _mm_set1_epi8( -1 );
+		for( ; x + 16 <= width; x += 16 )
+		{
+			__m128i alpha = _mm_loadu_si128( reinterpret_cast<const __m128i*>( source + x ) );
+			__m128i color = _mm_xor_si128( alpha, ones );
+			// Interleave to (color, color) and (color, alpha) pairs, then the pairs to whole pixels
+			__m128i colorColorLow = _mm_unpacklo_epi8( color, color );
+			__m128i colorColorHigh = _mm_unpackhi_epi8( color, color );
+			__m128i colorAlphaLow = _mm_unpacklo_epi8( color, alpha );
+			__m128i colorAlphaHigh = _mm_unpackhi_epi8( color, alpha );
+			__m128i* rgba = reinterpret_cast<__m128i*>( destination + x * 4 );
+			_mm_storeu_si128( rgba + 0, _mm_unpacklo_epi16( colorColorLow, colorAlphaLow ) );
+			_mm_storeu_si128( rgba + 1, _mm_unpackhi_epi16( colorColorLow, colorAlphaLow ) );
+			_mm_storeu_si128( rgba + 2, _mm_unpacklo_epi16( colorColorHigh, colorAlphaHigh ) );
+			_mm_storeu_si128( rgba + 3, _mm_unpackhi_epi16( colorColorHigh, colorAlphaHigh ) );
+		}
+#elif defined(TREX_NEON)
+		for( ; x + 16 <= width; x += 16 )
+		{
+			uint8x16_t alpha = vld1q_u8( source + x );
+			uint8x16_t color = vmvnq_u8( alpha );
+			vst4q_u8( destination + x * 4, uint8x16x4_t { { color, color, color, alpha } } );
+		}
+#endif
+		for( ; x < width; ++x )
+		{
+			uint8_t* rgba = destination + x * 4;
+			rgba[0] = rgba[1] = rgba[2] = 255 - source[x];
+			rgba[3] = source[x];
+		}
+	}
+
+	using BlitRowKernel = void (*)( const uint8_t* source, uint8_t* destination, size_t width );
+
+	// Copy a glyph row by row. The kernel is a template argument, so it is inlined into the row loop.
+	template<BlitRowKernel Kernel>
+	void BlitRows( const uint8_t* source, ptrdiff_t sourceStride, uint8_t* destination, size_t destinationStride, size_t width, size_t height )
+	{
+		for( size_t row = 0; row < height; ++row )
+			Kernel( source + static_cast<ptrdiff_t>( row ) * sourceStride, destination + row * destinationStride, width );
+	}
+}
@@ -1,8 +1,43 @@
 #include "Trex/Charset.hpp"
 #include <stdexcept>
+#include <algorithm>
 
 namespace Trex
 {
+	namespace
+	{
+		/**
+		* Returns true if the range starting later overlaps or directly follows the earlier one,
+		* so both can be merged into a single range.
+		*/
+		bool CanMerge(const Charset::Range& earlier, const Charset::Range& later)
+		{
+			return later.first <= earlier.second || later.first - earlier.second == 1;
+		}
+
+		/**
+		* Sort the ranges and merge the ones that overlap or touch.
+		*/
+		std::vector<Charset::Range> Normalize(std::vector<Charset::Range> ranges)
+		{
+			std::sort(ranges.begin(), ranges.end());
+			std::vector<Charset::Range> merged;
+			merged.reserve(ranges.size());
+			for (const auto& range : ranges)
+			{
+				if (not merged.empty() && CanMerge(merged.back(), range))
+				{
+					merged.back().second = std::max(merged.back().second, range.second);
+				}
+				else
+				{
+					merged.push_back(range);
+				}
+			}
+			return merged;
+		}
+	}
+
 	Charset::Charset(uint32_t first, uint32_t last)
 		: Charset(std::span<const Range>({{first,last}})) {}
 
@@ -17,10 +52,150 @@ namespace Trex
 			{
 				throw std::runtime_error("Error: invalid charset range");
 			}
-			for (uint32_t codepoint = first; codepoint <= last; codepoint++)
+		}
+		*this = FromNormalizedRanges(Normalize({ codepointRanges.begin(), codepointRanges.end() }));
+	}
+
+	Charset Charset::FromNormalizedRanges(std::vector<Range> ranges)
+	{
+		Charset charset;
+		for (const auto& [first, last] : ranges)
+		{
+			charset.m_Size += static_cast<size_t>(last - first) + 1;
+		}
+		charset.m_Ranges = std::move(ranges);
+		return charset;
+	}
+
+	void Charset::AddCodepoint(const uint32_t codepoint)
+	{
+		// First range that ends at or after the codepoint
+		auto next = std::lower_bound(m_Ranges.begin(), m_Ranges.end(), codepoint,
+			[](const Range& range, uint32_t value) { return range.second < value; });
+		if (next != m_Ranges.end() && next->first <= codepoint)
+		{
+			return; // Already in the charset
+		}
+
+		const bool extendsPrevious = next != m_Ranges.begin() && std::prev(next)->second + 1 == codepoint;
+		const bool extendsNext = next != m_Ranges.end() && next->first - 1 == codepoint;
+		if (extendsPrevious && extendsNext)
+		{
+			std::prev(next)->second = next->second;
+			m_Ranges.erase(next);
+		}
+		else if (extendsPrevious)
+		{
+			std::prev(next)->second = codepoint;
+		}
+		else if (extendsNext)
+		{
+			next->first = codepoint;
+		}
+		else
+		{
+			m_Ranges.insert(next, { codepoint, codepoint });
+		}
+		m_Size++;
+	}
+
+	bool Charset::Contains(const uint32_t codepoint) const
+	{
+		auto range = std::lower_bound(m_Ranges.begin(), m_Ranges.end(), codepoint,
+			[](const Range& range, uint32_t value) { return range.second < value; });
+		return range != m_Ranges.end() && range->first <= codepoint;
+	}
+
+	Charset Charset::Union(const Charset& other) const
+	{
+		if (IsFull() || other.IsFull())
+		{
+			return Full();
+		}
+
+		std::vector<Range> ranges;
+		ranges.reserve(m_Ranges.size() + other.m_Ranges.size());
+		std::merge(m_Ranges.begin(), m_Ranges.end(), other.m_Ranges.begin(), other.m_Ranges.end(), std::back_inserter(ranges));
+		return FromNormalizedRanges(Normalize(std::move(ranges)));
+	}
+
+	Charset Charset::Intersection(const Charset& other) const
+	{
+		if (IsFull())
+		{
+			return other;
+		}
+		if (other.IsFull())
+		{
+			return *this;
+		}
+
+		std::vector<Range> ranges;
+		auto a = m_Ranges.begin();
+		auto b = other.m_Ranges.begin();
+		while (a != m_Ranges.end() && b != other.m_Ranges.end())
+		{
+			const uint32_t first = std::max(a->first, b->first);
+			const uint32_t last = std::min(a->second, b->second);
+			if (first <= last)
+			{
+				ranges.emplace_back(first, last);
+			}
+			// The range ending first cannot overlap anything else
+			if (a->second < b->second)
+			{
+				++a;
+			}
+			else
+			{
+				++b;
+			}
+		}
+		return FromNormalizedRanges(std::move(ranges));
+	}
+
+	Charset Charset::Difference(const Charset& other) const
+	{
+		if (IsFull())
+		{
+			throw std::runtime_error("Error: cannot subtract from the full charset");
+		}
+		if (other.IsFull())
+		{
+			return Charset();
+		}
+
+		std::vector<Range> ranges;
+		auto removed = other.m_Ranges.begin();
+		for (auto [first, last] : m_Ranges)
+		{
+			// Skip the removed ranges that end before this range
+			while (removed != other.m_Ranges.end() && removed->second < first)
+			{
+				++removed;
+			}
+			// Cut out all removed ranges overlapping this range
+			auto cut = removed;
+			bool isEmpty = false;
+			while (cut != other.m_Ranges.end() && cut->first <= last)
+			{
+				if (cut->first > first)
+				{
+					ranges.emplace_back(first, cut->first - 1);
+				}
+				if (cut->second >= last)
+				{
+					isEmpty = true;
+					break;
+				}
+				first = cut->second + 1;
+				++cut;
+			}
+			if (not isEmpty)
 			{
-				m_Charset.insert(codepoint);
+				ranges.emplace_back(first, last);
 			}
 		}
+		return FromNormalizedRanges(std::move(ranges));
 	}
-}
\ No newline at end of file
+}
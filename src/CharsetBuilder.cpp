@@ -0,0 +1,371 @@
+#include "Trex/CharsetBuilder.hpp"
+#include "Trex/Font.hpp"
+#include "MappedFile.hpp"
+#include "Simd.hpp"
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+namespace Trex
+{
+	namespace
+	{
+		constexpr uint32_t MaxCodepoint = 0x10FFFF;
+		constexpr size_t CodepointWords = MaxCodepoint / 64 + 1;
+
+		// Texts shorter than this are not split between threads.
+		constexpr size_t MinBytesPerThread = 1 << 20;
+
+		void MarkCodepoint(std::span<uint64_t> codepoints, uint32_t codepoint)
+		{
+			// Most codepoints repeat, so checking first avoids a chain of stores to the same words
+			const uint64_t bit = uint64_t{ 1 } << (codepoint % 64);
+			if ((codepoints[codepoint / 64] & bit) == 0)
+			{
+				codepoints[codepoint / 64] |= bit;
+			}
+		}
+
+		bool IsContinuationByte(uint8_t byte)
+		{
+			return (byte & 0xC0) == 0x80;
+		}
+
+		/**
+		* Number of leading bytes that are ASCII, counted in whole SIMD blocks.
+		* The rest of the text is decoded one codepoint at a time.
+		*/
+		size_t SkipAsciiBlocks(const uint8_t* text, size_t size)
+		{
+			size_t i = 0;
+#if defined(TREX_AVX2)
+			for (; i + 32 <= size; i += 32)
+			{
+				if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i))) != 0)
+					break;
+			}
+#elif defined(TREX_SSE2)
+			for (; i + 16 <= size; i += 16)
+			{
+				if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i))) != 0)
+					break;
+			}
+#elif defined(TREX_NEON)
+			for (; i + 16 <= size; i += 16)
+			{
+				uint64x2_t highBits = vreinterpretq_u64_u8(vshrq_n_u8(vld1q_u8(text + i), 7));
+				if ((vgetq_lane_u64(highBits, 0) | vgetq_lane_u64(highBits, 1)) != 0)
+					break;
+			}
+#endif
+			return i;
+		}
+
+		/**
+		* Set of the ASCII characters found in the text, stored as a 128-bit bitmap. With a byte shuffle,
+		* a whole block of text is checked against the bitmap at once. Only blocks with new characters
+		* are added byte by byte, which is rare after the first few lines of a text.
+		*/
+		class AsciiSet
+		{
+		public:
+			void Add(const uint8_t* text, size_t size)
+			{
+				size_t i = 0;
+#if defined(TREX_SSSE3)
+				// Byte c / 8 of the bitmap has bit c % 8 set for every character c in the set
+				const __m128i bitOfColumn = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+				for (; i + 16 <= size; i += 16)
+				{
+					const __m128i characters = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+					const __m128i bitmap = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_Bits));
+					const __m128i rows = _mm_shuffle_epi8(bitmap, _mm_and_si128(_mm_srli_epi16(characters, 3), _mm_set1_epi8(0x0F)));
+					const __m128i columns = _mm_shuffle_epi8(bitOfColumn, _mm_and_si128(characters, _mm_set1_epi8(7)));
+					const __m128i missing = _mm_cmpeq_epi8(_mm_and_si128(rows, columns), _mm_setzero_si128());
+					if (_mm_movemask_epi8(missing) != 0)
+					{
+						AddEach(text + i, 16);
+					}
+				}
+#elif defined(TREX_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+				const uint8_t bitsOfColumns[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+				const uint8x16_t bitOfColumn = vld1q_u8(bitsOfColumns);
+				for (; i + 16 <= size; i += 16)
+				{
+					const uint8x16_t characters = vld1q_u8(text + i);
+					const uint8x16_t bitmap = vld1q_u8(reinterpret_cast<const uint8_t*>(m_Bits));
+					const uint8x16_t rows = vqtbl1q_u8(bitmap, vshrq_n_u8(characters, 3));
+					const uint8x16_t columns = vqtbl1q_u8(bitOfColumn, vandq_u8(characters, vdupq_n_u8(7)));
+					if (vminvq_u8(vtstq_u8(rows, columns)) == 0)
+					{
+						AddEach(text + i, 16);
+					}
+				}
+#endif
+				AddEach(text + i, size - i);
+			}
+
+			void MarkAll(std::span<uint64_t> codepoints) const
+			{
+				codepoints[0] |= m_Bits[0];
+				codepoints[1] |= m_Bits[1];
+			}
+
+		private:
+			void AddEach(const uint8_t* text, size_t size)
+			{
+				// Bits are collected in registers, so the loop does not wait for its own stores
+				uint64_t low = m_Bits[0], high = m_Bits[1];
+				for (size_t i = 0; i < size; ++i)
+				{
+					const uint64_t bit = uint64_t{ 1 } << (text[i] % 64);
+					low |= text[i] < 64 ? bit : 0;
+					high |= text[i] < 64 ? 0 : bit;
+				}
+				m_Bits[0] = low;
+				m_Bits[1] = high;
+			}
+
+			alignas(16) uint64_t m_Bits[2] = {};
+		};
+
+		/**
+		* Decode a single codepoint and return the number of its bytes.
+		* Overlong forms, surrogates and codepoints above U+10FFFF are rejected.
+		*/
+		size_t DecodeUtf8(const uint8_t* text, size_t size, uint32_t& codepoint)
+		{
+			const uint8_t lead = text[0];
+			if (lead < 0x80)
+			{
+				codepoint = lead;
+				return 1;
+			}
+
+			size_t length;
+			uint8_t minSecond = 0x80, maxSecond = 0xBF;
+			if (lead >= 0xC2 && lead <= 0xDF)
+			{
+				length = 2;
+				codepoint = lead & 0x1F;
+			}
+			else if (lead >= 0xE0 && lead <= 0xEF)
+			{
+				length = 3;
+				codepoint = lead & 0x0F;
+				minSecond = lead == 0xE0 ? 0xA0 : 0x80; // Overlong
+				maxSecond = lead == 0xED ? 0x9F : 0xBF; // Surrogates
+			}
+			else if (lead >= 0xF0 && lead <= 0xF4)
+			{
+				length = 4;
+				codepoint = lead & 0x07;
+				minSecond = lead == 0xF0 ? 0x90 : 0x80; // Overlong
+				maxSecond = lead == 0xF4 ? 0x8F : 0xBF; // Above U+10FFFF
+			}
+			else
+			{
+				throw std::runtime_error("Error: invalid UTF-8 text");
+			}
+
+			if (length > size || text[1] < minSecond || text[1] > maxSecond)
+			{
+				throw std::runtime_error("Error: invalid UTF-8 text");
+			}
+			for (size_t i = 1; i < length; ++i)
+			{
+				if (not IsContinuationByte(text[i]))
+				{
+					throw std::runtime_error("Error: invalid UTF-8 text");
+				}
+				codepoint = (codepoint << 6) | (text[i] & 0x3F);
+			}
+			return length;
+		}
+
+		/**
+		* Mark all codepoints starting in text[begin, end). The last codepoint may continue after the end.
+		*/
+		void ScanUtf8(std::span<const uint8_t> text, size_t begin, size_t end, std::span<uint64_t> codepoints)
+		{
+			const uint8_t* data = text.data();
+			AsciiSet ascii;
+			size_t i = begin;
+			while (i < end)
+			{
+				const size_t asciiEnd = i + SkipAsciiBlocks(data + i, end - i);
+				ascii.Add(data + i, asciiEnd - i);
+				i = asciiEnd;
+
+				// Decode at least a block one by one before trying the fast path again
+				const size_t scalarEnd = std::min(end, i + 16);
+				while (i < scalarEnd)
+				{
+					if (data[i] < 0x80)
+					{
+						ascii.Add(data + i, 1);
+						++i;
+						continue;
+					}
+					uint32_t codepoint;
+					i += DecodeUtf8(data + i, text.size() - i, codepoint);
+					MarkCodepoint(codepoints, codepoint);
+				}
+			}
+
+			ascii.MarkAll(codepoints);
+		}
+
+		/**
+		* Throw when the text is not valid UTF-8, without marking any codepoint.
+		*/
+		void ValidateUtf8(std::span<const uint8_t> text)
+		{
+			const uint8_t* data = text.data();
+			size_t i = 0;
+			while (i < text.size())
+			{
+				i += SkipAsciiBlocks(data + i, text.size() - i);
+				if (i < text.size() && data[i] < 0x80)
+				{
+					++i;
+				}
+				else if (i < text.size())
+				{
+					uint32_t codepoint;
+					i += DecodeUtf8(data + i, text.size() - i, codepoint);
+				}
+			}
+		}
+
+		/**
+		* Split the text into a chunk per thread. No chunk starts with a continuation byte, so every
+		* chunk can be decoded independently. Continuation bytes before a boundary are decoded by
+		* the previous chunk, which rejects them unless they end its last codepoint. So every byte
+		* is validated the same way for any number of threads.
+		*/
+		std::vector<size_t> GetChunkBoundaries(std::span<const uint8_t> text, unsigned int threads)
+		{
+			if (threads == 0)
+			{
+				threads = std::max(1u, std::thread::hardware_concurrency());
+			}
+			const size_t chunkCount = std::clamp<size_t>(text.size() / MinBytesPerThread, 1, threads);
+			std::vector<size_t> boundaries = { 0 };
+			for (size_t chunk = 1; chunk < chunkCount; ++chunk)
+			{
+				size_t boundary = std::max(text.size() * chunk / chunkCount, boundaries.back());
+				while (boundary < text.size() && IsContinuationByte(text[boundary]))
+				{
+					++boundary;
+				}
+				boundaries.push_back(boundary);
+			}
+			boundaries.push_back(text.size());
+			return boundaries;
+		}
+
+		/**
+		* Turn the set bits into sorted ranges of codepoints accepted by the filter.
+		*/
+		Charset ToCharset(std::span<const uint64_t> codepoints, const std::function<bool(uint32_t)>& accept)
+		{
+			std::vector<Charset::Range> ranges;
+			bool isOpen = false;
+			for (size_t word = 0; word < codepoints.size(); ++word)
+			{
+				if (codepoints[word] == 0 && not isOpen)
+				{
+					continue;
+				}
+				for (uint32_t bit = 0; bit < 64; ++bit)
+				{
+					const uint32_t codepoint = static_cast<uint32_t>(word * 64 + bit);
+					const bool isIncluded = (codepoints[word] >> bit & 1) != 0 && accept(codepoint);
+					if (isIncluded && isOpen)
+					{
+						ranges.back().second = codepoint;
+					}
+					else if (isIncluded)
+					{
+						ranges.emplace_back(codepoint, codepoint);
+					}
+					isOpen = isIncluded;
+				}
+			}
+			return Charset(ranges);
+		}
+	}
+
+	CharsetBuilder::CharsetBuilder(unsigned int threads)
+		: m_Threads(threads), m_Codepoints(CodepointWords, 0) {}
+
+	void CharsetBuilder::AddUtf8(std::span<const char> text)
+	{
+		const std::span<const uint8_t> bytes(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+		const std::vector<size_t> boundaries = GetChunkBoundaries(bytes, m_Threads);
+		const size_t chunkCount = boundaries.size() - 1;
+		if (chunkCount == 1)
+		{
+			// Invalid text must not leave the builder partly updated
+			ValidateUtf8(bytes);
+			ScanUtf8(bytes, 0, bytes.size(), m_Codepoints);
+			return;
+		}
+
+		// Each thread marks its own codepoints, which are merged afterwards
+		std::vector<std::vector<uint64_t>> chunkCodepoints(chunkCount, std::vector<uint64_t>(CodepointWords, 0));
+		std::vector<std::exception_ptr> errors(chunkCount);
+		{
+			std::vector<std::jthread> pool;
+			pool.reserve(chunkCount);
+			for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+			{
+				pool.emplace_back([&, chunk] {
+					try
+					{
+						ScanUtf8(bytes, boundaries[chunk], boundaries[chunk + 1], chunkCodepoints[chunk]);
+					}
+					catch (...)
+					{
+						errors[chunk] = std::current_exception();
+					}
+				});
+			}
+		} // Join all threads
+
+		for (const auto& error : errors)
+		{
+			if (error)
+			{
+				std::rethrow_exception(error);
+			}
+		}
+		for (const auto& codepoints : chunkCodepoints)
+		{
+			for (size_t word = 0; word < CodepointWords; ++word)
+			{
+				m_Codepoints[word] |= codepoints[word];
+			}
+		}
+	}
+
+	void CharsetBuilder::AddUtf8File(const std::string& path)
+	{
+		const MappedFile file(path);
+		const std::span<const uint8_t> data = file.Data();
+		AddUtf8({ reinterpret_cast<const char*>(data.data()), data.size() });
+	}
+
+	Charset CharsetBuilder::Build() const
+	{
+		return ToCharset(m_Codepoints, [](uint32_t) { return true; });
+	}
+
+	Charset CharsetBuilder::Build(const Font& font) const
+	{
+		return ToCharset(m_Codepoints, [&font](uint32_t codepoint) { return font.GetGlyphIndex(codepoint) != 0; });
+	}
+}
@@ -1,70 +1,160 @@
 #include "Trex/Font.hpp"
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include "FontFace.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
 #include FT_LCD_FILTER_H
+#include FT_SIZES_H
 
 #include <iostream>
+#include <utility>
 
 namespace Trex
 {
 	FT_Library GetFTLibrary()
 	{
-        static FT_Library library;
-
-		if (library == nullptr)
+		static const FT_Library library = []
 		{
-			if(FT_Init_FreeType(&library))
+			FT_Library newLibrary;
+			if (FT_Init_FreeType(&newLibrary))
 			{
 				throw std::runtime_error("Error: could not initialize FreeType library");
 			}
-		}
+			return newLibrary;
+		}();
 		return library;
 	}
 
-	Font::Font(const char* path)
+	std::mutex& GetFTLibraryMutex()
 	{
-		FT_Long faceIndex = 0; // Take the first face in the font file
-		FT_Library library = GetFTLibrary();
+		static std::mutex mutex;
+		return mutex;
+	}
 
-		if(FT_New_Face(library, path, faceIndex, &face))
+	FontFace::FontFace(std::shared_ptr<const void> dataOwner, std::span<const uint8_t> data, long faceIndex, FT_Library ownLibrary)
+		: dataOwner(std::move(dataOwner)), data(data), library(ownLibrary)
+	{
+		const auto fontDataBytes = reinterpret_cast<const FT_Byte*>(data.data());
+		const auto fontDataSize = static_cast<FT_Long>(data.size());
+		FT_Error error;
+		if (library != nullptr)
+		{
+			error = FT_New_Memory_Face(library, fontDataBytes, fontDataSize, faceIndex, &face);
+		}
+		else
+		{
+			std::lock_guard lock(GetFTLibraryMutex());
+			error = FT_New_Memory_Face(GetFTLibrary(), fontDataBytes, fontDataSize, faceIndex, &face);
+		}
+		if (error)
 		{
+			if (library != nullptr)
+			{
+				FT_Done_FreeType(library);
+			}
 			throw std::runtime_error("Error: could not load font");
 		}
+	}
 
-		SetSize(Points{ 12 }); // Default size
+	FontFace::~FontFace()
+	{
+		if (library != nullptr)
+		{
+			FT_Done_Face(face);
+			FT_Done_FreeType(library);
+		}
+		else
+		{
+			std::lock_guard lock(GetFTLibraryMutex());
+			FT_Done_Face(face);
+		}
 	}
 
-	Font::Font(std::span<const uint8_t> data)
-		: fontData(std::vector<uint8_t>(data.begin(), data.end()))
+	Font::Font(const char* path, long faceIndex)
 	{
-		FT_Long faceIndex = 0; // Take the first face in the font file
-		FT_Library library = GetFTLibrary();
-        const auto fontDataBytes = reinterpret_cast<const FT_Byte*>(fontData.data());
-        const auto fontDataSize = static_cast<long>(fontData.size());
+		auto file = std::make_shared<const MappedFile>(path);
+		const auto data = file->Data();
+		fontFace = std::make_shared<FontFace>(std::move(file), data, faceIndex);
+		face = fontFace->face;
+		CreateSize();
+		SetSize(Points{ 12 }); // Default size
+	}
 
-		if(FT_New_Memory_Face(library, fontDataBytes, fontDataSize, faceIndex, &face))
+	Font::Font(std::span<const uint8_t> data, DataOwnership ownership, long faceIndex)
+	{
+		if (ownership == DataOwnership::COPY)
 		{
-			throw std::runtime_error("Error: could not load font");
+			auto copy = std::make_shared<const std::vector<uint8_t>>(data.begin(), data.end());
+			const std::span<const uint8_t> copiedData = *copy;
+			fontFace = std::make_shared<FontFace>(std::move(copy), copiedData, faceIndex);
 		}
+		else
+		{
+			fontFace = std::make_shared<FontFace>(nullptr, data, faceIndex);
+		}
+		face = fontFace->face;
+		CreateSize();
+		SetSize(Points{ 12 }); // Default size
+	}
 
+	Font::Font(std::shared_ptr<FontFace> sharedFace)
+		: face(sharedFace->face), fontFace(std::move(sharedFace))
+	{
+		CreateSize();
 		SetSize(Points{ 12 }); // Default size
 	}
 
 	Font::Font(Font&& other) noexcept
+		: face(std::exchange(other.face, nullptr)),
+		  fontFace(std::move(other.fontFace)),
+		  ftSize(std::exchange(other.ftSize, nullptr)),
+		  fontSize(other.fontSize)
 	{
-		FT_Reference_Face(other.face);
-		face = other.face;
-		other.face = nullptr;
-		fontData = std::move(other.fontData);
 	}
 
 	Font::~Font()
 	{
-		FT_Done_Face(face);
+		if (ftSize != nullptr)
+		{
+			std::lock_guard lock(fontFace->mutex);
+			FT_Done_Size(ftSize);
+		}
+	}
+
+	void Font::CreateSize()
+	{
+		std::lock_guard lock(fontFace->mutex);
+		if (FT_New_Size(face, &ftSize))
+		{
+			throw std::runtime_error("Error: could not create font size");
+		}
+	}
+
+	Font Font::Clone() const
+	{
+		FT_Library ownLibrary;
+		if (FT_Init_FreeType(&ownLibrary))
+		{
+			throw std::runtime_error("Error: could not initialize FreeType library");
+		}
+		Font clone(std::make_shared<FontFace>(fontFace->dataOwner, fontFace->data, face->face_index, ownLibrary));
+		clone.SetSize(fontSize);
+		return clone;
+	}
+
+	std::unique_lock<std::recursive_mutex> Font::LockFace() const
+	{
+		std::unique_lock lock(fontFace->mutex);
+		if (face->size != ftSize)
+		{
+			FT_Activate_Size(ftSize);
+		}
+		return lock;
 	}
 
 	void Font::SetSize(const FontSize& size)
 	{
+		const auto lock = LockFace();
+		fontSize = size;
 		if (std::holds_alternative<Pixels>(size))
 		{
 			SetSizeInPixels(std::get<Pixels>(size));
@@ -111,16 +201,45 @@ namespace Trex
 
 	uint32_t Font::GetGlyphIndex(uint32_t codepoint) const
 	{
+		const auto lock = LockFace();
 		return FT_Get_Char_Index(face, codepoint);
 	}
 
 	FontMetrics Font::GetMetrics() const
 	{
 		FontMetrics metrics;
-		metrics.ascender = face->size->metrics.ascender / 64;
-		metrics.descender = face->size->metrics.descender / 64;
-		metrics.height = face->size->metrics.height / 64;
+		metrics.ascender = ftSize->metrics.ascender / 64;
+		metrics.descender = ftSize->metrics.descender / 64;
+		metrics.height = ftSize->metrics.height / 64;
 		return metrics;
 	}
 
-}
\ No newline at end of file
+	uint64_t Font::GetContentHash() const
+	{
+		std::call_once(fontFace->contentHashOnce, [this] {
+			const uint64_t faceHash = HashValue(static_cast<int64_t>(face->face_index));
+			fontFace->contentHash = HashBytes(fontFace->data, faceHash);
+		});
+		return fontFace->contentHash;
+	}
+
+	long Font::GetFaceIndex() const
+	{
+		return face->face_index;
+	}
+
+	long Font::GetFaceCount() const
+	{
+		return face->num_faces;
+	}
+
+	std::string Font::GetFamilyName() const
+	{
+		return face->family_name != nullptr ? face->family_name : "";
+	}
+
+	std::string Font::GetStyleName() const
+	{
+		return face->style_name != nullptr ? face->style_name : "";
+	}
+}
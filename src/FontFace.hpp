@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace Trex
+{
+	// The global library is initialized once. Faces of the global library are created and destroyed
+	// under the library lock, since FreeType does not synchronize them.
+	FT_Library GetFTLibrary();
+	std::mutex& GetFTLibraryMutex();
+
+	// FreeType face together with the font data it reads from.
+	// Fonts sharing a face parse the font tables once and each keep their own FT_Size.
+	struct FontFace
+	{
+		// ownLibrary is destroyed together with the face. Pass nullptr to use the global library.
+		FontFace(std::shared_ptr<const void> dataOwner, std::span<const uint8_t> data, long faceIndex, FT_Library ownLibrary = nullptr);
+		FontFace(const FontFace&) = delete;
+		FontFace& operator=(const FontFace&) = delete;
+		~FontFace();
+
+		std::shared_ptr<const void> dataOwner; // Copied data or a file mapping. Empty for borrowed data.
+		std::span<const uint8_t> data;
+		FT_Library library = nullptr; // Owned only by clones
+		FT_Face face = nullptr;
+		std::recursive_mutex mutex; // Guards the face and its sizes
+
+		// Hash of the data and the face index, computed once on first use
+		std::once_flag contentHashOnce;
+		uint64_t contentHash = 0;
+	};
+}
@@ -0,0 +1,134 @@
+#include "Trex/FontRegistry.hpp"
+#include "FontFace.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+
+namespace Trex
+{
+	FontRegistry& FontRegistry::Default()
+	{
+		static FontRegistry registry;
+		return registry;
+	}
+
+	std::shared_ptr<Font> FontRegistry::Get(const std::string& path, long faceIndex)
+	{
+		std::error_code error;
+		std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(path, error);
+		const std::string key = error ? path : canonicalPath.string();
+
+		std::lock_guard lock(m_Mutex);
+		return GetFromSource(m_SourcesByPath[key], faceIndex, [&](std::span<const uint8_t>& data) {
+			auto file = std::make_shared<const MappedFile>(path);
+			data = file->Data();
+			return std::shared_ptr<const void>(std::move(file));
+		});
+	}
+
+	std::shared_ptr<Font> FontRegistry::Get(std::span<const uint8_t> data, long faceIndex, DataOwnership ownership)
+	{
+		const bool isCopy = ownership == DataOwnership::COPY;
+		const ContentKey key = isCopy
+			? ContentKey{ HashBytes(data), nullptr }
+			: ContentKey{ data.size(), data.data() };
+
+		// Hashes of copied data can collide, so a source is reused only when its copy has the same bytes.
+		// A source whose copy was already released loads the new data, so it can be reused as well.
+		const auto holdsData = [&](const auto& entry) {
+			const Source& source = entry.second;
+			return not isCopy || source.dataOwner.expired() || std::ranges::equal(source.data, data);
+		};
+
+		std::lock_guard lock(m_Mutex);
+		auto [first, last] = m_SourcesByContent.equal_range(key);
+		auto entry = std::find_if(first, last, holdsData);
+		if (entry == last)
+		{
+			entry = m_SourcesByContent.emplace(key, Source{});
+		}
+		return GetFromSource(entry->second, faceIndex, [&](std::span<const uint8_t>& sourceData) {
+			if (ownership == DataOwnership::BORROW)
+			{
+				sourceData = data;
+				return std::shared_ptr<const void>();
+			}
+			auto copy = std::make_shared<const std::vector<uint8_t>>(data.begin(), data.end());
+			sourceData = *copy;
+			return std::shared_ptr<const void>(std::move(copy));
+		});
+	}
+
+	std::vector<std::shared_ptr<Font>> FontRegistry::GetAllFaces(const std::string& path)
+	{
+		std::vector<std::shared_ptr<Font>> fonts = { Get(path, 0) };
+		const long faceCount = fonts.front()->GetFaceCount();
+		fonts.reserve(faceCount);
+		for (long faceIndex = 1; faceIndex < faceCount; ++faceIndex)
+		{
+			fonts.push_back(Get(path, faceIndex));
+		}
+		return fonts;
+	}
+
+	size_t FontRegistry::SourceCount() const
+	{
+		std::lock_guard lock(m_Mutex);
+		return m_SourcesByPath.size() + m_SourcesByContent.size();
+	}
+
+	size_t FontRegistry::FaceCount() const
+	{
+		std::lock_guard lock(m_Mutex);
+		size_t count = 0;
+		const auto countFaces = [&](const Source& source) {
+			for (const auto& [faceIndex, face] : source.faces)
+			{
+				count += face.expired() ? 0 : 1;
+			}
+		};
+		for (const auto& [key, source] : m_SourcesByPath)
+		{
+			countFaces(source);
+		}
+		for (const auto& [key, source] : m_SourcesByContent)
+		{
+			countFaces(source);
+		}
+		return count;
+	}
+
+	/**
+	* A face missing from the source is opened from the data of the other faces of the source while any of them
+	* is alive, so the faces of a collection never load the data twice. Borrowed data is used directly.
+	* Sources without any face alive are pruned, so loading many buffers does not grow the registry.
+	*/
+	std::shared_ptr<Font> FontRegistry::GetFromSource(Source& source, long faceIndex, const LoadData& loadData)
+	{
+		std::weak_ptr<FontFace>& entry = source.faces[faceIndex];
+		std::shared_ptr<FontFace> face = entry.lock();
+		if (face == nullptr)
+		{
+			std::shared_ptr<const void> dataOwner = source.dataOwner.lock();
+			if (dataOwner == nullptr)
+			{
+				dataOwner = loadData(source.data);
+				source.dataOwner = dataOwner;
+			}
+			face = std::make_shared<FontFace>(std::move(dataOwner), source.data, faceIndex);
+			entry = face;
+		}
+
+		// The face is alive, so its own source is never pruned
+		const auto isExpired = [](const auto& entry) {
+			return std::ranges::all_of(entry.second.faces, [](const auto& face) { return face.second.expired(); });
+		};
+		std::erase_if(m_SourcesByPath, isExpired);
+		std::erase_if(m_SourcesByContent, isExpired);
+
+		// The constructor is private, so std::make_shared cannot be used
+		return std::shared_ptr<Font>(new Font(std::move(face)));
+	}
+}
@@ -0,0 +1,123 @@
+#include "Trex/FontStack.hpp"
+#include "Trex/Font.hpp"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <algorithm>
+#include <stdexcept>
+
+namespace Trex
+{
+	namespace
+	{
+		constexpr uint32_t MaxCodepoint = 0x10FFFF;
+		constexpr size_t MaxFonts = 255;
+
+		/**
+		* Call process(codepoint) for every codepoint in the character map of the font.
+		*/
+		template<typename Process>
+		void ForEachMappedCodepoint(const Font& font, Process process)
+		{
+			const auto lock = font.LockFace();
+			FT_UInt glyphIndex;
+			FT_ULong codepoint = FT_Get_First_Char(font.face, &glyphIndex);
+			while (glyphIndex != 0)
+			{
+				if (codepoint <= MaxCodepoint)
+				{
+					process(static_cast<uint32_t>(codepoint));
+				}
+				codepoint = FT_Get_Next_Char(font.face, codepoint, &glyphIndex);
+			}
+		}
+	}
+
+	FontStack::FontStack(std::shared_ptr<Font> font)
+		: FontStack(std::vector{ std::move(font) })
+	{
+	}
+
+	FontStack::FontStack(std::vector<std::shared_ptr<Font>> fonts)
+		: m_Fonts(std::move(fonts))
+	{
+		if (m_Fonts.empty() || m_Fonts.size() > MaxFonts)
+		{
+			throw std::runtime_error("Error: a font stack needs from 1 to 255 fonts");
+		}
+		if (std::ranges::find(m_Fonts, nullptr) != m_Fonts.end())
+		{
+			throw std::runtime_error("Error: a font stack cannot contain a null font");
+		}
+
+		m_GlyphOffsets.reserve(m_Fonts.size() + 1);
+		m_GlyphOffsets.push_back(0);
+		for (const auto& font : m_Fonts)
+		{
+			m_GlyphOffsets.push_back(m_GlyphOffsets.back() + static_cast<uint32_t>(font->face->num_glyphs));
+		}
+
+		if (m_Fonts.size() > 1)
+		{
+			ResolveAllCodepoints();
+		}
+	}
+
+	/**
+	* Fonts are applied from the last to the first, so each codepoint ends up with the first font covering it.
+	* Blocks are allocated only for codepoints of fallback fonts. The primary font only overwrites existing blocks.
+	*/
+	void FontStack::ResolveAllCodepoints()
+	{
+		m_FontPages.assign(MaxCodepoint / BlockSize + 1, 0);
+		m_FontBlocks.assign(BlockSize, 0);
+
+		for (size_t font = m_Fonts.size(); font-- > 0;)
+		{
+			ForEachMappedCodepoint(*m_Fonts[font], [&](uint32_t codepoint) {
+				uint16_t& block = m_FontPages[codepoint / BlockSize];
+				if (block == 0)
+				{
+					if (font == 0)
+					{
+						return; // Block 0 already resolves to the primary font
+					}
+					block = static_cast<uint16_t>(m_FontBlocks.size() / BlockSize);
+					m_FontBlocks.resize(m_FontBlocks.size() + BlockSize, 0);
+				}
+				m_FontBlocks[block * BlockSize + codepoint % BlockSize] = static_cast<uint8_t>(font);
+			});
+		}
+	}
+
+	uint32_t FontStack::GetGlyphIndex(uint32_t codepoint) const
+	{
+		const size_t font = ResolveCodepoint(codepoint);
+		return m_GlyphOffsets[font] + m_Fonts[font]->GetGlyphIndex(codepoint);
+	}
+
+	size_t FontStack::GetFontOfGlyph(uint32_t glyphIndex) const
+	{
+		const auto next = std::upper_bound(m_GlyphOffsets.begin() + 1, m_GlyphOffsets.end() - 1, glyphIndex);
+		return static_cast<size_t>(next - (m_GlyphOffsets.begin() + 1));
+	}
+
+	std::vector<std::unique_lock<std::recursive_mutex>> FontStack::LockFaces() const
+	{
+		// A single order of all faces prevents deadlocks between stacks listing shared faces in different orders
+		std::vector<const Font*> fonts;
+		fonts.reserve(m_Fonts.size());
+		for (const auto& font : m_Fonts)
+		{
+			fonts.push_back(font.get());
+		}
+		std::ranges::sort(fonts, std::less{}, [](const Font* font) { return font->face; });
+
+		std::vector<std::unique_lock<std::recursive_mutex>> locks;
+		locks.reserve(fonts.size());
+		for (const Font* font : fonts)
+		{
+			locks.push_back(font->LockFace());
+		}
+		return locks;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+namespace Trex
+{
+	// 64-bit FNV-1a hash. Hashes can be chained by passing the previous hash as the seed.
+	constexpr uint64_t HashSeed = 14695981039346656037ull;
+
+	inline uint64_t HashBytes(std::span<const uint8_t> bytes, uint64_t seed = HashSeed)
+	{
+		constexpr uint64_t prime = 1099511628211ull;
+		uint64_t hash = seed;
+		for (uint8_t byte : bytes)
+		{
+			hash = (hash ^ byte) * prime;
+		}
+		return hash;
+	}
+
+	// Only for types without padding bytes (integers, enums)
+	template<typename T>
+	requires std::has_unique_object_representations_v<T>
+	uint64_t HashValue(const T& value, uint64_t seed = HashSeed)
+	{
+		return HashBytes({ reinterpret_cast<const uint8_t*>(&value), sizeof(T) }, seed);
+	}
+}
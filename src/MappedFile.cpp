@@ -0,0 +1,134 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Trex
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& path)
+	{
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Error: could not open file");
+		}
+
+		LARGE_INTEGER size{};
+		if (not GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("Error: could not read file size");
+		}
+		m_Size = static_cast<size_t>(size.QuadPart);
+		if (m_Size == 0)
+		{
+			CloseHandle(file);
+			return; // Empty files cannot be mapped
+		}
+
+		m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file); // The mapping keeps the file open
+		if (m_Mapping == nullptr)
+		{
+			throw std::runtime_error("Error: could not map file");
+		}
+
+		m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		if (m_Data == nullptr)
+		{
+			CloseHandle(m_Mapping);
+			throw std::runtime_error("Error: could not map file");
+		}
+	}
+
+	void MappedFile::Unmap()
+	{
+		if (m_Data != nullptr)
+		{
+			UnmapViewOfFile(m_Data);
+			CloseHandle(m_Mapping);
+		}
+		m_Data = nullptr;
+		m_Mapping = nullptr;
+		m_Size = 0;
+	}
+#else
+	MappedFile::MappedFile(const std::string& path)
+	{
+		int file = open(path.c_str(), O_RDONLY);
+		if (file == -1)
+		{
+			throw std::runtime_error("Error: could not open file");
+		}
+
+		struct stat status{};
+		if (fstat(file, &status) == -1)
+		{
+			close(file);
+			throw std::runtime_error("Error: could not read file size");
+		}
+		m_Size = static_cast<size_t>(status.st_size);
+		if (m_Size == 0)
+		{
+			close(file);
+			return; // Empty files cannot be mapped
+		}
+
+		void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file); // The mapping keeps the file open
+		if (data == MAP_FAILED)
+		{
+			throw std::runtime_error("Error: could not map file");
+		}
+		m_Data = static_cast<const uint8_t*>(data);
+	}
+
+	void MappedFile::Unmap()
+	{
+		if (m_Data != nullptr)
+		{
+			munmap(const_cast<uint8_t*>(m_Data), m_Size);
+		}
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+#endif
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+		: m_Data(std::exchange(other.m_Data, nullptr)), m_Size(std::exchange(other.m_Size, 0))
+#ifdef _WIN32
+		, m_Mapping(std::exchange(other.m_Mapping, nullptr))
+#endif
+	{
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Unmap();
+			m_Data = std::exchange(other.m_Data, nullptr);
+			m_Size = std::exchange(other.m_Size, 0);
+#ifdef _WIN32
+			m_Mapping = std::exchange(other.m_Mapping, nullptr);
+#endif
+		}
+		return *this;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Unmap();
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <string>
+
+namespace Trex
+{
+	// Read-only memory mapping of a whole file. The file is unmapped when the object is destroyed.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& path);
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+
+		std::span<const uint8_t> Data() const { return { m_Data, m_Size }; }
+		size_t Size() const { return m_Size; }
+
+	private:
+		void Unmap();
+
+		const uint8_t* m_Data = nullptr;
+		size_t m_Size = 0;
+#ifdef _WIN32
+		void* m_Mapping = nullptr; // HANDLE of the file mapping object
+#endif
+	};
+}
@@ -0,0 +1,561 @@
+#include "Packer.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <cmath>
+#include <limits>
+#include <bit>
+
+namespace Trex
+{
+namespace
+{
+	constexpr unsigned int MinPowerOfTwoAtlasSize = 128;
+	constexpr unsigned int ShelfHeightAlignment = 4; // New shelves are a bit higher to fit similar rectangles
+
+	unsigned int NextPowerOfTwo(unsigned int value)
+	{
+		unsigned int result = 1;
+		while (result < value)
+		{
+			result *= 2;
+		}
+		return result;
+	}
+
+	std::optional<std::vector<PackerPosition>> PackInOrder(
+		RectPacker& packer, std::span<const PackerRect> rects, std::span<const size_t> order)
+	{
+		std::vector<PackerPosition> positions(rects.size());
+		for (size_t index : order)
+		{
+			auto position = packer.Insert(rects[index]);
+			if (not position.has_value())
+			{
+				return std::nullopt;
+			}
+			positions[index] = *position;
+		}
+		return positions;
+	}
+
+	std::optional<PackerResult> PackInOrder(PackingMethod method, std::span<const PackerRect> rects,
+		std::span<const size_t> order, unsigned int width, unsigned int height)
+	{
+		auto packer = CreatePacker(method, width, height);
+		auto positions = PackInOrder(*packer, rects, order);
+		if (not positions.has_value())
+		{
+			return std::nullopt;
+		}
+
+		return PackerResult{ std::move(*positions), packer->UsedWidth(), packer->UsedHeight() };
+	}
+
+} // namespace
+
+	void RectPacker::MarkUsed(PackerPosition position, PackerRect rect)
+	{
+		m_UsedWidth = std::max(m_UsedWidth, position.x + rect.width);
+		m_UsedHeight = std::max(m_UsedHeight, position.y + rect.height);
+	}
+
+	void RectPacker::Remove(PackerPosition, PackerRect)
+	{
+		throw std::runtime_error("Error: packer does not support removing rectangles");
+	}
+
+	std::optional<PackerPosition> ShelfPacker::Insert(PackerRect rect)
+	{
+		if (rect.width > m_Width)
+		{
+			return std::nullopt;
+		}
+
+		int x = m_X;
+		int y = m_Y;
+		unsigned int rowHeight = std::max(m_RowHeight, rect.height);
+		if (x + rect.width > m_Width) // Next row
+		{
+			x = 0;
+			y += static_cast<int>(rowHeight);
+			rowHeight = rect.height;
+		}
+		if (y + rect.height > m_Height)
+		{
+			return std::nullopt;
+		}
+
+		m_X = x + static_cast<int>(rect.width);
+		m_Y = y;
+		m_RowHeight = rowHeight;
+
+		PackerPosition position{ x, y };
+		MarkUsed(position, rect);
+		return position;
+	}
+
+	SkylinePacker::SkylinePacker(unsigned int width, unsigned int height, SkylineHeuristic heuristic)
+		: RectPacker(width, height), m_Skyline{ Segment{ 0, 0, width } }, m_Heuristic(heuristic)
+	{
+	}
+
+	std::optional<PackerPosition> SkylinePacker::Insert(PackerRect rect)
+	{
+		std::optional<size_t> bestSegment;
+		Fit bestFit{};
+		for (size_t i = 0; i < m_Skyline.size(); ++i)
+		{
+			auto fit = FitAt(i, rect);
+			if (fit.has_value() && (not bestSegment.has_value() || IsBetterFit(*fit, bestFit)))
+			{
+				bestSegment = i;
+				bestFit = *fit;
+			}
+		}
+		const PackerPosition bestPosition{ bestSegment.has_value() ? m_Skyline[*bestSegment].x : 0, bestFit.y };
+
+		if (not bestSegment.has_value())
+		{
+			return std::nullopt;
+		}
+
+		AddSegment(*bestSegment, bestPosition, rect);
+		MarkUsed(bestPosition, rect);
+		return bestPosition;
+	}
+
+	/**
+	* Find the lowest y at which the rectangle can be placed with its left edge
+	* at the beginning of the given skyline segment, and the area it would leave unused below itself.
+	*/
+	std::optional<SkylinePacker::Fit> SkylinePacker::FitAt(size_t segmentIndex, PackerRect rect) const
+	{
+		const int x = m_Skyline[segmentIndex].x;
+		if (x + rect.width > m_Width)
+		{
+			return std::nullopt;
+		}
+
+		int y = 0;
+		unsigned int remainingWidth = rect.width;
+		for (size_t i = segmentIndex; remainingWidth > 0; ++i)
+		{
+			y = std::max(y, m_Skyline[i].y);
+			if (y + rect.height > m_Height)
+			{
+				return std::nullopt;
+			}
+			remainingWidth -= std::min(remainingWidth, m_Skyline[i].width);
+		}
+
+		uint64_t waste = 0;
+		remainingWidth = rect.width;
+		for (size_t i = segmentIndex; remainingWidth > 0; ++i)
+		{
+			const unsigned int coveredWidth = std::min(remainingWidth, m_Skyline[i].width);
+			waste += static_cast<uint64_t>(y - m_Skyline[i].y) * coveredWidth;
+			remainingWidth -= coveredWidth;
+		}
+		return Fit{ y, waste, y + rect.height > m_UsedHeight };
+	}
+
+	bool SkylinePacker::IsBetterFit(const Fit& fit, const Fit& best) const
+	{
+		if (m_Heuristic == SkylineHeuristic::MIN_WASTE)
+		{
+			if (fit.growsUsedHeight != best.growsUsedHeight)
+			{
+				return not fit.growsUsedHeight;
+			}
+			if (not fit.growsUsedHeight && fit.waste != best.waste)
+			{
+				return fit.waste < best.waste;
+			}
+		}
+		return fit.y < best.y;
+	}
+
+	void SkylinePacker::AddSegment(size_t segmentIndex, PackerPosition position, PackerRect rect)
+	{
+		const Segment newSegment{ position.x, position.y + static_cast<int>(rect.height), rect.width };
+		m_Skyline.insert(m_Skyline.begin() + static_cast<std::ptrdiff_t>(segmentIndex), newSegment);
+
+		// Shrink or remove segments covered by the new one
+		const int newSegmentEnd = newSegment.x + static_cast<int>(newSegment.width);
+		for (size_t i = segmentIndex + 1; i < m_Skyline.size();)
+		{
+			Segment& segment = m_Skyline[i];
+			if (segment.x >= newSegmentEnd)
+			{
+				break;
+			}
+			const unsigned int overlap = newSegmentEnd - segment.x;
+			if (segment.width <= overlap)
+			{
+				m_Skyline.erase(m_Skyline.begin() + static_cast<std::ptrdiff_t>(i));
+				continue;
+			}
+			segment.x += static_cast<int>(overlap);
+			segment.width -= overlap;
+			break;
+		}
+
+		// Merge neighbouring segments at the same height
+		for (size_t i = 0; i + 1 < m_Skyline.size();)
+		{
+			if (m_Skyline[i].y == m_Skyline[i + 1].y)
+			{
+				m_Skyline[i].width += m_Skyline[i + 1].width;
+				m_Skyline.erase(m_Skyline.begin() + static_cast<std::ptrdiff_t>(i + 1));
+				continue;
+			}
+			++i;
+		}
+	}
+
+	/**
+	* Use the shelf of the most similar height that has enough free space.
+	* If there is none, an empty shelf is split or a new shelf is opened below the others.
+	*/
+	std::optional<PackerPosition> ShelfAllocator::Insert(PackerRect rect)
+	{
+		if (rect.width > m_Width)
+		{
+			return std::nullopt;
+		}
+
+		Shelf* bestShelf = nullptr;
+		for (auto& shelf : m_Shelves)
+		{
+			const bool isHighEnough = shelf.height >= rect.height;
+			const bool isNotTooHigh = shelf.height <= rect.height + std::max(rect.height / 2, ShelfHeightAlignment);
+			const bool isBetter = bestShelf == nullptr || shelf.height < bestShelf->height;
+			if (isHighEnough && isNotTooHigh && isBetter && not IsEmpty(shelf))
+			{
+				auto span = std::find_if(shelf.freeSpans.begin(), shelf.freeSpans.end(),
+					[&](const Span& span) { return span.width >= rect.width; });
+				if (span != shelf.freeSpans.end())
+				{
+					bestShelf = &shelf;
+				}
+			}
+		}
+
+		std::optional<PackerPosition> position;
+		if (bestShelf != nullptr)
+		{
+			position = InsertIntoShelf(*bestShelf, rect);
+		}
+		if (not position.has_value())
+		{
+			position = InsertIntoEmptyShelf(rect);
+		}
+		if (not position.has_value())
+		{
+			position = InsertIntoNewShelf(rect);
+		}
+
+		if (position.has_value())
+		{
+			MarkUsed(*position, rect);
+		}
+		return position;
+	}
+
+	void ShelfAllocator::Remove(PackerPosition position, PackerRect rect)
+	{
+		auto shelf = std::find_if(m_Shelves.begin(), m_Shelves.end(),
+			[&](const Shelf& shelf) { return shelf.y == position.y; });
+		if (shelf == m_Shelves.end())
+		{
+			throw std::runtime_error("Error: rectangle was not allocated");
+		}
+
+		auto& spans = shelf->freeSpans;
+		auto next = std::find_if(spans.begin(), spans.end(), [&](const Span& span) { return span.x > position.x; });
+		auto inserted = spans.insert(next, Span{ position.x, rect.width });
+
+		// Merge with neighbouring free spans
+		auto following = std::next(inserted);
+		if (following != spans.end() && inserted->x + static_cast<int>(inserted->width) == following->x)
+		{
+			inserted->width += following->width;
+			spans.erase(following);
+		}
+		if (inserted != spans.begin())
+		{
+			auto previous = std::prev(inserted);
+			if (previous->x + static_cast<int>(previous->width) == inserted->x)
+			{
+				previous->width += inserted->width;
+				spans.erase(inserted);
+			}
+		}
+
+		MergeEmptyShelves();
+	}
+
+	std::optional<PackerPosition> ShelfAllocator::InsertIntoShelf(Shelf& shelf, PackerRect rect)
+	{
+		auto span = std::find_if(shelf.freeSpans.begin(), shelf.freeSpans.end(),
+			[&](const Span& span) { return span.width >= rect.width; });
+		if (span == shelf.freeSpans.end())
+		{
+			return std::nullopt;
+		}
+
+		PackerPosition position{ span->x, shelf.y };
+		span->x += static_cast<int>(rect.width);
+		span->width -= rect.width;
+		if (span->width == 0)
+		{
+			shelf.freeSpans.erase(span);
+		}
+		return position;
+	}
+
+	std::optional<PackerPosition> ShelfAllocator::InsertIntoEmptyShelf(PackerRect rect)
+	{
+		for (size_t i = 0; i < m_Shelves.size(); ++i)
+		{
+			if (IsEmpty(m_Shelves[i]) && m_Shelves[i].height >= rect.height)
+			{
+				// Split the empty shelf. The rest of it stays empty.
+				const unsigned int remainingHeight = m_Shelves[i].height - rect.height;
+				m_Shelves[i].height = rect.height;
+				if (remainingHeight > 0)
+				{
+					const int y = m_Shelves[i].y + static_cast<int>(rect.height);
+					Shelf remainder{ y, remainingHeight, { Span{ 0, m_Width } } };
+					m_Shelves.insert(m_Shelves.begin() + static_cast<std::ptrdiff_t>(i + 1), remainder);
+				}
+				return InsertIntoShelf(m_Shelves[i], rect);
+			}
+		}
+		return std::nullopt;
+	}
+
+	std::optional<PackerPosition> ShelfAllocator::InsertIntoNewShelf(PackerRect rect)
+	{
+		const unsigned int bottom = m_Shelves.empty() ? 0 : m_Shelves.back().y + m_Shelves.back().height;
+		const unsigned int alignedHeight = (rect.height + ShelfHeightAlignment - 1) / ShelfHeightAlignment * ShelfHeightAlignment;
+		const unsigned int freeHeight = m_Height - bottom;
+		if (freeHeight < rect.height)
+		{
+			return std::nullopt;
+		}
+
+		m_Shelves.push_back(Shelf{ static_cast<int>(bottom), std::min(alignedHeight, freeHeight), { Span{ 0, m_Width } } });
+		return InsertIntoShelf(m_Shelves.back(), rect);
+	}
+
+	bool ShelfAllocator::IsEmpty(const Shelf& shelf) const
+	{
+		return shelf.freeSpans.size() == 1 && shelf.freeSpans.front().width == m_Width;
+	}
+
+	/**
+	* Join neighbouring empty shelves, so they can be reused for higher rectangles.
+	* Empty shelves at the bottom are removed.
+	*/
+	void ShelfAllocator::MergeEmptyShelves()
+	{
+		for (size_t i = 0; i + 1 < m_Shelves.size();)
+		{
+			if (IsEmpty(m_Shelves[i]) && IsEmpty(m_Shelves[i + 1]))
+			{
+				m_Shelves[i].height += m_Shelves[i + 1].height;
+				m_Shelves.erase(m_Shelves.begin() + static_cast<std::ptrdiff_t>(i + 1));
+				continue;
+			}
+			++i;
+		}
+		if (not m_Shelves.empty() && IsEmpty(m_Shelves.back()))
+		{
+			m_Shelves.pop_back();
+		}
+	}
+
+	std::unique_ptr<RectPacker> CreatePacker(PackingMethod method, unsigned int width, unsigned int height)
+	{
+		switch (method)
+		{
+		case PackingMethod::SHELF: return std::make_unique<ShelfPacker>(width, height);
+		case PackingMethod::SKYLINE: return std::make_unique<SkylinePacker>(width, height);
+		case PackingMethod::SKYLINE_MIN_WASTE: return std::make_unique<SkylinePacker>(width, height, SkylineHeuristic::MIN_WASTE);
+		default: throw std::runtime_error("Error: unsupported packing method");
+		}
+	}
+
+	std::vector<size_t> GetPackingOrder(PackingMethod method, std::span<const PackerRect> rects)
+	{
+		std::vector<size_t> order(rects.size());
+		std::iota(order.begin(), order.end(), 0);
+
+		// Shelf packer keeps the charset order. Other packers work best with the tallest rectangles first.
+		if (method != PackingMethod::SHELF)
+		{
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+				if (rects[a].height != rects[b].height)
+					return rects[a].height > rects[b].height;
+				return rects[a].width > rects[b].width;
+			});
+		}
+		return order;
+	}
+
+	std::optional<PackerResult> PackAll(
+		PackingMethod method, std::span<const PackerRect> rects, unsigned int width, unsigned int height)
+	{
+		return PackInOrder(method, rects, GetPackingOrder(method, rects), width, height);
+	}
+
+	std::optional<std::vector<PackerPosition>> PackAll(
+		RectPacker& packer, PackingMethod method, std::span<const PackerRect> rects)
+	{
+		return PackInOrder(packer, rects, GetPackingOrder(method, rects));
+	}
+
+	/**
+	* Estimate the atlas width from the total area of all rectangles.
+	* No atlas narrower than that can fit all the rectangles.
+	*/
+	unsigned int GetMinAtlasWidth(std::span<const PackerRect> rects, SizeConstraint constraint)
+	{
+		uint64_t totalArea = 0;
+		unsigned int maxWidth = 1;
+		for (const auto& rect : rects)
+		{
+			totalArea += static_cast<uint64_t>(rect.width) * rect.height;
+			maxWidth = std::max(maxWidth, rect.width);
+		}
+
+		auto width = std::max(maxWidth, static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(totalArea)))));
+		if (constraint != SizeConstraint::NONE)
+		{
+			width = std::max(MinPowerOfTwoAtlasSize, NextPowerOfTwo(width));
+		}
+		return width;
+	}
+
+	unsigned int GetAtlasHeight(unsigned int usedHeight, unsigned int width, SizeConstraint constraint)
+	{
+		usedHeight = std::max(usedHeight, 1u);
+		switch (constraint)
+		{
+		case SizeConstraint::POWER_OF_TWO_SQUARE: return std::max(width, NextPowerOfTwo(usedHeight));
+		case SizeConstraint::POWER_OF_TWO: return NextPowerOfTwo(usedHeight);
+		case SizeConstraint::NONE: return usedHeight;
+		default: throw std::runtime_error("Error: unsupported size constraint");
+		}
+	}
+
+	/**
+	* The atlas width is estimated from the total area and all rectangles are packed once
+	* with unbounded height. The layout is packed again with doubled width only when
+	* a square atlas is required and the rectangles do not fit into it.
+	*/
+	AtlasLayout PackAtlas(PackingMethod method, std::span<const PackerRect> rects, SizeConstraint constraint)
+	{
+		const auto order = GetPackingOrder(method, rects);
+		unsigned int width = GetMinAtlasWidth(rects, constraint);
+		while (true)
+		{
+			auto packed = PackInOrder(method, rects, order, width, UnboundedHeight);
+			if (not packed.has_value())
+			{
+				throw std::runtime_error("Error: glyphs do not fit into the atlas");
+			}
+
+			const unsigned int usedWidth = std::max(packed->usedWidth, 1u);
+			const unsigned int usedHeight = std::max(packed->usedHeight, 1u);
+			switch (constraint)
+			{
+			case SizeConstraint::POWER_OF_TWO_SQUARE:
+				if (usedHeight > width)
+				{
+					width *= 2;
+					continue;
+				}
+				return AtlasLayout{ width, width, std::move(packed->positions) };
+			case SizeConstraint::POWER_OF_TWO:
+				return AtlasLayout{ NextPowerOfTwo(usedWidth), NextPowerOfTwo(usedHeight), std::move(packed->positions) };
+			case SizeConstraint::NONE:
+				return AtlasLayout{ usedWidth, usedHeight, std::move(packed->positions) };
+			default:
+				throw std::runtime_error("Error: unsupported size constraint");
+			}
+		}
+	}
+
+	unsigned int GetPageSizeLimit(unsigned int maxPageSize, SizeConstraint constraint)
+	{
+		if (maxPageSize == 0)
+		{
+			return UnboundedHeight;
+		}
+		if (constraint == SizeConstraint::NONE)
+		{
+			return maxPageSize;
+		}
+		return std::bit_floor(maxPageSize);
+	}
+
+	/**
+	* When all rectangles fit into a single page, the layout is the same as from PackAtlas.
+	* Otherwise pages are filled one after another and a rectangle is placed on the first page
+	* with enough space. All pages have the same size, so they can be stored in a texture array.
+	*/
+	AtlasLayout PackAtlasPages(
+		PackingMethod method, std::span<const PackerRect> rects, SizeConstraint constraint, unsigned int maxPageSize)
+	{
+		const unsigned int pageSize = GetPageSizeLimit(maxPageSize, constraint);
+		if (maxPageSize == 0 || GetMinAtlasWidth(rects, constraint) <= pageSize)
+		{
+			AtlasLayout layout = PackAtlas(method, rects, constraint);
+			if (layout.width <= pageSize && layout.height <= pageSize)
+			{
+				return layout;
+			}
+		}
+
+		std::vector<std::unique_ptr<RectPacker>> pages;
+		std::vector<PackerPosition> positions(rects.size());
+		std::vector<unsigned int> rectPages(rects.size());
+		for (size_t index : GetPackingOrder(method, rects))
+		{
+			if (rects[index].width > pageSize || rects[index].height > pageSize)
+			{
+				throw std::runtime_error("Error: glyph is larger than the max page size");
+			}
+
+			std::optional<PackerPosition> position;
+			size_t page = 0;
+			for (; page < pages.size() && not position.has_value(); ++page)
+			{
+				position = pages[page]->Insert(rects[index]);
+			}
+			if (not position.has_value())
+			{
+				pages.push_back(CreatePacker(method, pageSize, pageSize));
+				position = pages.back()->Insert(rects[index]);
+				page = pages.size();
+			}
+
+			positions[index] = *position;
+			rectPages[index] = static_cast<unsigned int>(page - 1);
+		}
+
+		unsigned int usedWidth = 1;
+		unsigned int usedHeight = 1;
+		for (const auto& page : pages)
+		{
+			usedWidth = std::max(usedWidth, page->UsedWidth());
+			usedHeight = std::max(usedHeight, page->UsedHeight());
+		}
+		const unsigned int width = constraint == SizeConstraint::NONE ? usedWidth : pageSize;
+		const unsigned int height = GetAtlasHeight(usedHeight, width, constraint);
+		return AtlasLayout{ width, height, std::move(positions), std::move(rectPages), static_cast<unsigned int>(pages.size()) };
+	}
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+#include <limits>
+#include "Trex/Atlas.hpp"
+
+namespace Trex
+{
+	struct PackerRect
+	{
+		unsigned int width, height;
+	};
+
+	struct PackerPosition
+	{
+		int x, y; // Top left corner of the rectangle
+	};
+
+	// Places rectangles inside a bin of a fixed size. Rectangles never overlap.
+	class RectPacker
+	{
+	public:
+		RectPacker(unsigned int width, unsigned int height)
+			: m_Width(width), m_Height(height) {}
+		virtual ~RectPacker() = default;
+
+		// Returns std::nullopt when there is no space left for the rectangle.
+		virtual std::optional<PackerPosition> Insert(PackerRect rect) = 0;
+		virtual std::unique_ptr<RectPacker> Clone() const = 0;
+		// Free the space of a rectangle returned by Insert.
+		virtual void Remove(PackerPosition position, PackerRect rect);
+
+		unsigned int Width() const { return m_Width; }
+		unsigned int Height() const { return m_Height; }
+
+		// Bounding box of all inserted rectangles (measured from the top left corner)
+		unsigned int UsedWidth() const { return m_UsedWidth; }
+		unsigned int UsedHeight() const { return m_UsedHeight; }
+
+	protected:
+		void MarkUsed(PackerPosition position, PackerRect rect);
+
+		unsigned int m_Width;
+		unsigned int m_Height;
+		unsigned int m_UsedWidth = 0;
+		unsigned int m_UsedHeight = 0;
+	};
+
+	// Rectangles are placed left to right in rows. A new row starts below the tallest rectangle.
+	class ShelfPacker : public RectPacker
+	{
+	public:
+		using RectPacker::RectPacker;
+		std::optional<PackerPosition> Insert(PackerRect rect) override;
+		std::unique_ptr<RectPacker> Clone() const override { return std::make_unique<ShelfPacker>(*this); }
+
+	private:
+		int m_X = 0;
+		int m_Y = 0;
+		unsigned int m_RowHeight = 0;
+	};
+
+	// BOTTOM_LEFT: the lowest position of the skyline.
+	// MIN_WASTE: the position leaving the least free area below the rectangle, among positions which
+	// do not grow the used height. When every position grows it, the lowest one is used.
+	enum class SkylineHeuristic { BOTTOM_LEFT, MIN_WASTE };
+
+	// Rectangles are placed on top of the skyline at the position chosen by the heuristic.
+	class SkylinePacker : public RectPacker
+	{
+	public:
+		SkylinePacker(unsigned int width, unsigned int height, SkylineHeuristic heuristic = SkylineHeuristic::BOTTOM_LEFT);
+		std::optional<PackerPosition> Insert(PackerRect rect) override;
+		std::unique_ptr<RectPacker> Clone() const override { return std::make_unique<SkylinePacker>(*this); }
+
+	private:
+		struct Segment
+		{
+			int x, y;
+			unsigned int width;
+		};
+		struct Fit
+		{
+			int y;
+			uint64_t waste; // Free area left between the skyline and the bottom of the rectangle
+			bool growsUsedHeight;
+		};
+
+		std::optional<Fit> FitAt(size_t segmentIndex, PackerRect rect) const;
+		bool IsBetterFit(const Fit& fit, const Fit& best) const;
+		void AddSegment(size_t segmentIndex, PackerPosition position, PackerRect rect);
+
+		std::vector<Segment> m_Skyline;
+		SkylineHeuristic m_Heuristic;
+	};
+
+	// Rectangles are placed in shelves of similar height. Removed rectangles make space
+	// for new ones, so the allocator can be used for a cache of a fixed size.
+	class ShelfAllocator : public RectPacker
+	{
+	public:
+		using RectPacker::RectPacker;
+		std::optional<PackerPosition> Insert(PackerRect rect) override;
+		void Remove(PackerPosition position, PackerRect rect) override;
+		std::unique_ptr<RectPacker> Clone() const override { return std::make_unique<ShelfAllocator>(*this); }
+
+	private:
+		struct Span
+		{
+			int x;
+			unsigned int width;
+		};
+		struct Shelf
+		{
+			int y;
+			unsigned int height;
+			std::vector<Span> freeSpans; // Sorted by x
+		};
+
+		std::optional<PackerPosition> InsertIntoShelf(Shelf& shelf, PackerRect rect);
+		std::optional<PackerPosition> InsertIntoEmptyShelf(PackerRect rect);
+		std::optional<PackerPosition> InsertIntoNewShelf(PackerRect rect);
+		bool IsEmpty(const Shelf& shelf) const;
+		void MergeEmptyShelves();
+
+		std::vector<Shelf> m_Shelves; // Sorted by y
+	};
+
+	// Height of a bin that grows downwards for as long as needed.
+	constexpr unsigned int UnboundedHeight = std::numeric_limits<int>::max();
+
+	std::unique_ptr<RectPacker> CreatePacker(PackingMethod method, unsigned int width, unsigned int height);
+
+	// Order in which rectangles should be inserted to get the best results from the packer.
+	std::vector<size_t> GetPackingOrder(PackingMethod method, std::span<const PackerRect> rects);
+
+	struct PackerResult
+	{
+		std::vector<PackerPosition> positions; // In the same order as the packed rectangles
+		unsigned int usedWidth, usedHeight;
+	};
+
+	// Pack all rectangles at once. Returns std::nullopt if the rectangles do not fit into the bin.
+	std::optional<PackerResult> PackAll(
+		PackingMethod method, std::span<const PackerRect> rects, unsigned int width, unsigned int height);
+
+	// Pack all rectangles into an existing packer, which keeps track of the remaining free space.
+	std::optional<std::vector<PackerPosition>> PackAll(
+		RectPacker& packer, PackingMethod method, std::span<const PackerRect> rects);
+
+	// The narrowest atlas width that can fit all rectangles, estimated from their total area.
+	unsigned int GetMinAtlasWidth(std::span<const PackerRect> rects, SizeConstraint constraint);
+
+	// The smallest atlas height that covers the used height and is allowed by the size constraint.
+	unsigned int GetAtlasHeight(unsigned int usedHeight, unsigned int width, SizeConstraint constraint);
+
+	struct AtlasLayout
+	{
+		unsigned int width, height; // Size of every page of the atlas bitmap
+		std::vector<PackerPosition> positions; // In the same order as the packed rectangles
+		std::vector<unsigned int> pages {}; // Page of every rectangle. Empty when there is a single page.
+		unsigned int pageCount = 1;
+	};
+
+	// Find the smallest atlas allowed by the size constraint and pack all rectangles into it.
+	AtlasLayout PackAtlas(PackingMethod method, std::span<const PackerRect> rects, SizeConstraint constraint);
+
+	// Like PackAtlas, but rectangles are spread across pages when the atlas would be larger than maxPageSize.
+	// 0 means that the page size is unlimited.
+	AtlasLayout PackAtlasPages(
+		PackingMethod method, std::span<const PackerRect> rects, SizeConstraint constraint, unsigned int maxPageSize);
+
+	// The largest page size allowed by both the limit and the size constraint.
+	unsigned int GetPageSizeLimit(unsigned int maxPageSize, SizeConstraint constraint);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Instruction sets available at compile time. SSE2 is a part of every x86-64 target,
+// SSSE3 and AVX2 are enabled by compiler flags (e.g. -march=native or /arch:AVX2).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TREX_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define TREX_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define TREX_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define TREX_NEON
+#include <arm_neon.h>
+#endif
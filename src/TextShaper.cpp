@@ -1,54 +1,525 @@
 #include "Trex/TextShaper.hpp"
+#include "Hash.hpp"
 #include "hb.h"
 #include "hb-ft.h"
+#include <algorithm>
 #include <limits>
+#include <utility>
 
 namespace Trex
 {
+	namespace
+	{
+		/**
+		* HarfBuzz takes the scale from the active size of the face. The face of a clone is used only
+		* by one shaper, so the size of the font stays active.
+		*/
+		hb_font_t* CreateHarfBuzzFont(const Font& clone)
+		{
+			const auto lock = clone.LockFace();
+			return hb_ft_font_create_referenced(clone.face);
+		}
+
+		void AddToBuffer(hb_buffer_t* buffer, std::span<const char> text, unsigned int offset, unsigned int length)
+		{
+			hb_buffer_add_utf8(buffer, text.data(), (int)text.size(), offset, (int)length);
+		}
+
+		void AddToBuffer(hb_buffer_t* buffer, std::span<const uint32_t> codepoints, unsigned int offset, unsigned int length)
+		{
+			hb_buffer_add_codepoints(buffer, codepoints.data(), (int)codepoints.size(), offset, (int)length);
+		}
+
+		size_t GlyphCount(const ShapedGlyphs& glyphs)
+		{
+			return glyphs.size();
+		}
+
+		size_t GlyphCount(const ShapedText& text)
+		{
+			return text.Size();
+		}
+
+		void Truncate(ShapedGlyphs& glyphs, size_t size)
+		{
+			glyphs.erase(glyphs.begin() + static_cast<std::ptrdiff_t>(size), glyphs.end());
+		}
+
+		void Truncate(ShapedText& text, size_t size)
+		{
+			text.Resize(size);
+		}
+
+		void AppendGlyphs(const ShapedGlyphs& glyphs, ShapedGlyphs& output)
+		{
+			output.insert(output.end(), glyphs.begin(), glyphs.end());
+		}
+
+		void AppendGlyphs(const ShapedGlyphs& glyphs, ShapedText& output)
+		{
+			const size_t offset = output.Size();
+			output.Resize(offset + glyphs.size());
+			for (size_t i = 0; i < glyphs.size(); ++i)
+			{
+				output.glyphIndices[offset + i] = glyphs[i].info.glyphIndex;
+				output.xOffsets[offset + i] = glyphs[i].xOffset;
+				output.yOffsets[offset + i] = glyphs[i].yOffset;
+				output.xAdvances[offset + i] = glyphs[i].xAdvance;
+				output.yAdvances[offset + i] = glyphs[i].yAdvance;
+			}
+		}
+
+		template<typename Char>
+		std::span<const uint8_t> AsBytes(std::span<const Char> text)
+		{
+			return { reinterpret_cast<const uint8_t*>(text.data()), text.size_bytes() };
+		}
+
+		/**
+		* Marks, joiners, variation selectors, emoji modifiers and tags belong to the preceding character,
+		* so they are shaped with its font even when an earlier font of the stack has them.
+		*/
+		bool ContinuesFontRun(uint32_t codepoint)
+		{
+			if (codepoint >= 0x1F3FB && codepoint <= 0x1F3FF) // Emoji skin tone modifiers
+			{
+				return true;
+			}
+			switch (hb_unicode_general_category(hb_unicode_funcs_get_default(), codepoint))
+			{
+			case HB_UNICODE_GENERAL_CATEGORY_NON_SPACING_MARK:
+			case HB_UNICODE_GENERAL_CATEGORY_SPACING_MARK:
+			case HB_UNICODE_GENERAL_CATEGORY_ENCLOSING_MARK:
+			case HB_UNICODE_GENERAL_CATEGORY_FORMAT:
+				return true;
+			default:
+				return false;
+			}
+		}
+	}
+
+	void ShapedText::Resize(size_t size)
+	{
+		glyphIndices.resize(size);
+		xOffsets.resize(size);
+		yOffsets.resize(size);
+		xAdvances.resize(size);
+		yAdvances.resize(size);
+	}
+
+	void ShapedText::Reserve(size_t size)
+	{
+		glyphIndices.reserve(size);
+		xOffsets.reserve(size);
+		yOffsets.reserve(size);
+		xAdvances.reserve(size);
+		yAdvances.reserve(size);
+	}
 
 	TextShaper::TextShaper(const Trex::Atlas& atlas)
-		: m_Glyphs(atlas.GetGlyphs()),
-		  m_AtlasFont(atlas.GetFont()),
-		  m_Buffer(hb_buffer_create()),
-		  m_Font(hb_ft_font_create_referenced(m_AtlasFont->face))
+		: m_Glyphs(atlas.GetSharedGlyphs()),
+		  m_Fonts(atlas.GetFontStack()),
+		  m_Buffer(hb_buffer_create())
 	{
+		m_ShapingFonts.reserve(m_Fonts->Size());
+		m_HarfBuzzFonts.reserve(m_Fonts->Size());
+		for (size_t font = 0; font < m_Fonts->Size(); ++font)
+		{
+			const Font& clone = m_ShapingFonts.emplace_back(m_Fonts->GetFont(font)->Clone());
+			m_HarfBuzzFonts.push_back(CreateHarfBuzzFont(clone));
+		}
+	}
+
+	TextShaper::TextShaper(Trex::Atlas& atlas, LoadMissingGlyphs)
+		: TextShaper(std::as_const(atlas))
+	{
+		if (atlas.IsDynamic())
+		{
+			m_DynamicAtlas = &atlas;
+			m_Glyphs = nullptr; // Glyphs are loaded from the atlas, so it does not have to copy the table on the next change
+		}
 	}
 
 	TextShaper::~TextShaper()
 	{
 		hb_buffer_destroy(m_Buffer);
-		hb_font_destroy(m_Font);
+		for (hb_font_t* font : m_HarfBuzzFonts)
+		{
+			hb_font_destroy(font); // Before the clone it references
+		}
 	}
 
 	ShapedGlyphs TextShaper::ShapeUtf8(const std::span<const char> text)
 	{
-		ResetBuffer();
-		hb_buffer_add_utf8(m_Buffer, text.data(), (int)text.size(), 0, (int)text.size());
-		hb_shape(m_Font, m_Buffer, nullptr, 0);
-
-		return GetShapedGlyphs();
+		ShapedGlyphs glyphs;
+		ShapeInto(text, glyphs);
+		return glyphs;
 	}
 
 	ShapedGlyphs TextShaper::ShapeUtf32(const std::span<const char32_t> text)
 	{
-		// Unfortunately casting char32_t* to uint32_t* violates the strict aliasing rule.
-		// char32_t and uint32_t are not the same type, even though they are both 32 bits wide.
-		std::vector<uint32_t> codepoints(text.begin(), text.end());
-		return ShapeUnicode(codepoints);
+		ShapedGlyphs glyphs;
+		ShapeInto(text, glyphs);
+		return glyphs;
 	}
 
 	ShapedGlyphs TextShaper::ShapeUnicode(const std::span<const uint32_t> codepoints)
+	{
+		ShapedGlyphs glyphs;
+		ShapeInto(codepoints, glyphs);
+		return glyphs;
+	}
+
+	void TextShaper::ShapeUtf8(const std::span<const char> text, ShapedGlyphs& output)
+	{
+		ShapeInto(text, output);
+	}
+
+	void TextShaper::ShapeUtf32(const std::span<const char32_t> text, ShapedGlyphs& output)
+	{
+		ShapeInto(text, output);
+	}
+
+	void TextShaper::ShapeUnicode(const std::span<const uint32_t> codepoints, ShapedGlyphs& output)
+	{
+		ShapeInto(codepoints, output);
+	}
+
+	void TextShaper::ShapeUtf8(const std::span<const char> text, ShapedText& output)
+	{
+		ShapeInto(text, output);
+	}
+
+	void TextShaper::ShapeUtf32(const std::span<const char32_t> text, ShapedText& output)
+	{
+		ShapeInto(text, output);
+	}
+
+	void TextShaper::ShapeUnicode(const std::span<const uint32_t> codepoints, ShapedText& output)
+	{
+		ShapeInto(codepoints, output);
+	}
+
+	SharedShapedGlyphs TextShaper::ShapeUtf8Shared(const std::span<const char> text)
+	{
+		return ShapeShared(text);
+	}
+
+	SharedShapedGlyphs TextShaper::ShapeUnicodeShared(const std::span<const uint32_t> codepoints)
+	{
+		return ShapeShared(codepoints);
+	}
+
+	void TextShaper::SetCacheCapacity(size_t capacity, ShapeCacheMode mode)
+	{
+		if (mode != m_CacheMode)
+		{
+			ClearCache();
+		}
+		m_CacheCapacity = capacity;
+		m_CacheMode = mode;
+		while (m_CacheEntries.size() > m_CacheCapacity)
+		{
+			m_CacheIndex.erase(m_CacheEntries.back().hash);
+			m_CacheEntries.pop_back();
+		}
+		m_CacheStats.size = m_CacheEntries.size();
+	}
+
+	ShapeCacheStats TextShaper::GetCacheStats() const
+	{
+		return m_CacheStats;
+	}
+
+	void TextShaper::ClearCache()
+	{
+		m_CacheEntries.clear();
+		m_CacheIndex.clear();
+		m_CacheStats = {};
+	}
+
+	/**
+	* Text using fallback fonts is shaped in runs of one font. Each run is added with the whole text as
+	* its context, so HarfBuzz still sees the neighbouring characters.
+	*/
+	template<typename AddText, typename Output>
+	void TextShaper::Shape(AddText addText, unsigned int textLength, Output& output, std::vector<GlyphCluster>* clusters)
 	{
 		ResetBuffer();
-		hb_buffer_add_codepoints(m_Buffer, codepoints.data(), (int)codepoints.size(), 0, (int)codepoints.size());
-		hb_shape(m_Font, m_Buffer, nullptr, 0);
+		addText(0, textLength);
+		if (m_HarfBuzzFonts.size() == 1)
+		{
+			ShapeBuffer(0);
+			AddShapedGlyphs(0, output, clusters);
+			return;
+		}
 
-		return GetShapedGlyphs();
+		FindFontRuns(textLength);
+		for (const FontRun& run : m_FontRuns)
+		{
+			if (m_FontRuns.size() > 1)
+			{
+				ResetBuffer();
+				addText(run.offset, run.length);
+			}
+			ShapeBuffer(run.font);
+			AddShapedGlyphs(run.font, output, clusters);
+		}
+	}
+
+	template<typename Char, typename Output>
+	void TextShaper::ShapeText(std::span<const Char> text, Output& output, std::vector<GlyphCluster>* clusters)
+	{
+		if constexpr (std::is_same_v<Char, char32_t>)
+		{
+			// Unfortunately casting char32_t* to uint32_t* violates the strict aliasing rule.
+			// char32_t and uint32_t are not the same type, even though they are both 32 bits wide.
+			// The vector is reused by every text, so it allocates only when it grows.
+			m_Utf32Text.assign(text.begin(), text.end());
+			Shape([&](unsigned int offset, unsigned int length) {
+				hb_buffer_add_utf32(m_Buffer, m_Utf32Text.data(), (int)m_Utf32Text.size(), offset, (int)length);
+			}, static_cast<unsigned int>(text.size()), output, clusters);
+		}
+		else
+		{
+			Shape([&](unsigned int offset, unsigned int length) {
+				AddToBuffer(m_Buffer, text, offset, length);
+			}, static_cast<unsigned int>(text.size()), output, clusters);
+		}
+	}
+
+	/**
+	* Only a miss of the cache allocates memory. Once `output` is large enough, shaping without the cache or with
+	* cache hits allocates nothing, since HarfBuzz reuses its buffer as well.
+	*/
+	template<typename Char, typename Output>
+	void TextShaper::ShapeInto(std::span<const Char> text, Output& output)
+	{
+		if (m_CacheCapacity == 0)
+		{
+			ShapeText(text, output);
+		}
+		else if (m_CacheMode == ShapeCacheMode::WORDS)
+		{
+			if (not AddWordGlyphs(text, output))
+			{
+				ShapeText(text, output);
+			}
+		}
+		else
+		{
+			AppendGlyphs(*ShapeCached(text), output);
+		}
+	}
+
+	template<typename Char>
+	SharedShapedGlyphs TextShaper::ShapeShared(std::span<const Char> text)
+	{
+		if (m_CacheCapacity != 0 && m_CacheMode == ShapeCacheMode::TEXT)
+		{
+			return ShapeCached(text);
+		}
+		auto glyphs = std::make_shared<ShapedGlyphs>();
+		ShapeInto(text, *glyphs);
+		return glyphs;
+	}
+
+	/**
+	* Shaping depends only on the text and its encoding, because the fonts, direction, script and language
+	* of a shaper never change.
+	*/
+	template<typename Char>
+	SharedShapedGlyphs TextShaper::ShapeCached(std::span<const Char> text)
+	{
+		const auto textBytes = AsBytes(text);
+		const uint64_t hash = HashBytes(textBytes, HashValue(EncodingOf<Char>()));
+		if (const CacheEntry* entry = FindCacheEntry(hash, EncodingOf<Char>(), textBytes))
+		{
+			return entry->glyphs;
+		}
+		auto glyphs = std::make_shared<ShapedGlyphs>();
+		ShapeText(text, *glyphs);
+		return AddCacheEntry(hash, EncodingOf<Char>(), textBytes, std::move(glyphs));
+	}
+
+	/**
+	* The text is split into words and runs of spaces, which are shaped and cached separately. Glyph advances
+	* are relative, so the glyphs of the pieces are simply joined. When the glyphs of any piece depend on its
+	* neighbours (e.g. the font kerns a letter with a space), nothing is added and false is returned,
+	* so the whole text must be shaped at once instead.
+	*/
+	template<typename Char, typename Output>
+	bool TextShaper::AddWordGlyphs(std::span<const Char> text, Output& output)
+	{
+		const size_t initialSize = GlyphCount(output);
+		size_t begin = 0;
+		while (begin < text.size())
+		{
+			const bool isSpace = text[begin] == Char{ ' ' };
+			size_t end = begin + 1;
+			while (end < text.size() && (text[end] == Char{ ' ' }) == isSpace)
+			{
+				++end;
+			}
+
+			const SharedShapedGlyphs wordGlyphs = ShapeWord(text.subspan(begin, end - begin));
+			if (wordGlyphs == nullptr)
+			{
+				Truncate(output, initialSize);
+				return false;
+			}
+			AppendGlyphs(*wordGlyphs, output);
+			begin = end;
+		}
+		return true;
+	}
+
+	/**
+	* The word is shaped between two spaces, as it would be inside a paragraph. HarfBuzz marks a glyph as unsafe
+	* to break when the glyphs before it would change if the text were split there. If the first glyph of the
+	* word or the space after it is marked, the word cannot be shaped on its own, which is cached as null.
+	* The same holds when a padding space is not a glyph of its own, e.g. when the word starts with a combining
+	* mark or a joiner, which HarfBuzz merges into the cluster of the space.
+	*/
+	template<typename Char>
+	SharedShapedGlyphs TextShaper::ShapeWord(std::span<const Char> word)
+	{
+		const auto wordBytes = AsBytes(word);
+		const uint64_t hash = HashBytes(wordBytes, HashValue(EncodingOf<Char>()));
+		if (const CacheEntry* entry = FindCacheEntry(hash, EncodingOf<Char>(), wordBytes))
+		{
+			return entry->glyphs;
+		}
+
+		std::vector<Char> padded;
+		padded.reserve(word.size() + 2);
+		padded.push_back(Char{ ' ' });
+		padded.insert(padded.end(), word.begin(), word.end());
+		padded.push_back(Char{ ' ' });
+
+		std::vector<GlyphCluster> clusters;
+		ShapedGlyphs glyphs;
+		ShapeText(std::span<const Char>(padded), glyphs, &clusters);
+		const unsigned int lastSpace = static_cast<unsigned int>(padded.size() - 1);
+		const auto glyphsOf = [&](unsigned int cluster) { return std::ranges::count(clusters, cluster, &GlyphCluster::cluster); };
+		const bool hasSeparateSpaces = clusters.size() >= 2
+			&& clusters.front().cluster == 0 && clusters[1].cluster == 1 && clusters.back().cluster == lastSpace
+			&& glyphsOf(0) == 1 && glyphsOf(lastSpace) == 1;
+		const bool isSafe = hasSeparateSpaces && std::ranges::none_of(clusters, [&](const GlyphCluster& glyph) {
+			return glyph.unsafeToBreak && (glyph.cluster == 1 || glyph.cluster == lastSpace);
+		});
+
+		SharedShapedGlyphs wordGlyphs;
+		if (isSafe)
+		{
+			wordGlyphs = std::make_shared<const ShapedGlyphs>(glyphs.begin() + 1, glyphs.end() - 1);
+		}
+		return AddCacheEntry(hash, EncodingOf<Char>(), wordBytes, std::move(wordGlyphs));
+	}
+
+	/**
+	* Entries are kept in the order of use, so the least recently used one is dropped when the cache is full.
+	*/
+	const TextShaper::CacheEntry* TextShaper::FindCacheEntry(uint64_t hash, TextEncoding encoding, std::span<const uint8_t> text)
+	{
+		const auto indexed = m_CacheIndex.find(hash);
+		if (indexed == m_CacheIndex.end())
+		{
+			++m_CacheStats.misses;
+			return nullptr;
+		}
+
+		CacheEntry& entry = *indexed->second;
+		if (entry.encoding != encoding || not std::ranges::equal(entry.text, text))
+		{
+			m_CacheEntries.erase(indexed->second); // Hash collision. The newer text replaces the older one.
+			m_CacheIndex.erase(indexed);
+			++m_CacheStats.misses;
+			return nullptr;
+		}
+
+		++m_CacheStats.hits;
+		m_CacheEntries.splice(m_CacheEntries.begin(), m_CacheEntries, indexed->second);
+		if (m_DynamicAtlas != nullptr && entry.glyphs != nullptr)
+		{
+			RefreshAtlasGlyphs(entry);
+		}
+		return &entry;
+	}
+
+	SharedShapedGlyphs TextShaper::AddCacheEntry(uint64_t hash, TextEncoding encoding, std::span<const uint8_t> text, SharedShapedGlyphs glyphs)
+	{
+		if (m_CacheEntries.size() == m_CacheCapacity)
+		{
+			m_CacheIndex.erase(m_CacheEntries.back().hash);
+			m_CacheEntries.pop_back();
+		}
+		m_CacheEntries.push_front({ hash, encoding, { text.begin(), text.end() }, glyphs });
+		m_CacheIndex.emplace(hash, m_CacheEntries.begin());
+		m_CacheStats.size = m_CacheEntries.size();
+		return glyphs;
+	}
+
+	/**
+	* Glyphs of a dynamic atlas may be evicted and added again at another place after the text was shaped.
+	* Loading them again also marks them as used. Holders of the old result keep it unchanged.
+	*/
+	void TextShaper::RefreshAtlasGlyphs(CacheEntry& entry)
+	{
+		std::shared_ptr<ShapedGlyphs> refreshed;
+		for (size_t i = 0; i < entry.glyphs->size(); ++i)
+		{
+			const Glyph& cached = (*entry.glyphs)[i].info;
+			const Glyph current = m_DynamicAtlas->LoadGlyphByIndex(cached.glyphIndex);
+			if (current == cached)
+			{
+				continue;
+			}
+			if (refreshed == nullptr)
+			{
+				refreshed = std::make_shared<ShapedGlyphs>(*entry.glyphs);
+			}
+			(*refreshed)[i].info = current;
+		}
+		if (refreshed != nullptr)
+		{
+			entry.glyphs = std::move(refreshed);
+		}
+	}
+
+	/**
+	* Split the text in the buffer into runs of consecutive characters resolved to the same font.
+	* Clusters of the buffer are still the offsets of the characters in the text.
+	*/
+	void TextShaper::FindFontRuns(unsigned int textLength)
+	{
+		unsigned int length;
+		const hb_glyph_info_t* infos = hb_buffer_get_glyph_infos(m_Buffer, &length);
+
+		std::vector<FontRun>& runs = m_FontRuns;
+		runs.clear();
+		for (unsigned int i = 0; i < length; ++i)
+		{
+			const size_t font = m_Fonts->ResolveCodepoint(infos[i].codepoint);
+			if (not runs.empty() && (font == runs.back().font || ContinuesFontRun(infos[i].codepoint)))
+			{
+				continue;
+			}
+			if (not runs.empty())
+			{
+				runs.back().length = infos[i].cluster - runs.back().offset;
+			}
+			runs.push_back({ font, infos[i].cluster, 0 });
+		}
+		if (not runs.empty())
+		{
+			runs.back().length = textLength - runs.back().offset;
+		}
 	}
 
 	FontMetrics TextShaper::GetFontMetrics() const
 	{
-		return m_AtlasFont->GetMetrics();
+		return m_Fonts->GetPrimaryFont()->GetMetrics();
 	}
 
 	TextMeasurement TextShaper::Measure(const Trex::ShapedGlyphs& glyphs)
@@ -57,9 +528,9 @@ namespace Trex
 			return TextMeasurement{}; // Filled with zeros
 
 		float minY = std::numeric_limits<float>::max();
-		float maxY = std::numeric_limits<float>::min();
+		float maxY = std::numeric_limits<float>::lowest();
 		float minX = std::numeric_limits<float>::max();
-		float maxX = std::numeric_limits<float>::min();
+		float maxX = std::numeric_limits<float>::lowest();
 		float cursorX = 0.0f;
 		float cursorY = 0.0f;
 		for (const auto& glyph : glyphs)
@@ -86,39 +557,111 @@ namespace Trex
 		};
 	}
 
+	/**
+	* Same as measuring ShapedGlyphs, but atlas data of every glyph is looked up by its index.
+	*/
+	TextMeasurement TextShaper::Measure(const ShapedText& text) const
+	{
+		if (text.Empty())
+			return TextMeasurement{}; // Filled with zeros
+
+		float minY = std::numeric_limits<float>::max();
+		float maxY = std::numeric_limits<float>::lowest();
+		float minX = std::numeric_limits<float>::max();
+		float maxX = std::numeric_limits<float>::lowest();
+		float cursorX = 0.0f;
+		float cursorY = 0.0f;
+		for (size_t i = 0; i < text.Size(); ++i)
+		{
+			const Glyph& glyph = GetGlyph(text.glyphIndices[i]);
+			const float x = cursorX + text.xOffsets[i] + (float)glyph.bearingX;
+			const float y = cursorY + text.yOffsets[i] - (float)glyph.bearingY;
+
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x + (float)glyph.width);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y + (float)glyph.height);
+
+			cursorX += text.xAdvances[i];
+			cursorY += text.yAdvances[i];
+		}
+
+		return TextMeasurement {
+				.width = maxX - minX,
+				.height = maxY - minY,
+				.xOffset = minX,
+				.yOffset = minY,
+				.xAdvance = cursorX,
+				.yAdvance = cursorY
+		};
+	}
+
 	Glyph TextShaper::GetAtlasGlyph(uint32_t index)
 	{
-		const auto& glyphs = m_Glyphs.Data();
-		return glyphs.contains( index ) ? glyphs.at( index ) : m_Glyphs.GetUnknownGlyph();
+		if (m_DynamicAtlas != nullptr)
+		{
+			return m_DynamicAtlas->LoadGlyphByIndex( index );
+		}
+		return m_Glyphs->GetGlyphByIndex( index );
 	}
 
-	ShapedGlyphs TextShaper::GetShapedGlyphs()
+	const Glyph& TextShaper::GetGlyph(uint32_t glyphIndex) const
 	{
+		if (m_DynamicAtlas != nullptr)
+		{
+			return m_DynamicAtlas->GetGlyphs().GetGlyphByIndex(glyphIndex);
+		}
+		return m_Glyphs->GetGlyphByIndex(glyphIndex);
+	}
+
+	template<typename Output>
+	void TextShaper::AddShapedGlyphs(size_t font, Output& output, std::vector<GlyphCluster>* clusters)
+	{
+		const uint32_t glyphOffset = m_Fonts->GetGlyphOffset(font);
 		unsigned int glyphCount;
 		hb_glyph_info_t* glyphInfo = hb_buffer_get_glyph_infos(m_Buffer, &glyphCount);
 		hb_glyph_position_t* glyphPos = hb_buffer_get_glyph_positions(m_Buffer, &glyphCount);
 
-		ShapedGlyphs glyphs;
-		glyphs.reserve(glyphCount);
 		for (unsigned int i = 0; i < glyphCount; i++)
 		{
-			ShapedGlyph glyph = GetShapedGlyph(glyphInfo[i], glyphPos[i]);
-			glyphs.push_back(glyph);
+			// After shaping codepoint becomes glyph index in the font of the run
+			AddShapedGlyph(glyphOffset + glyphInfo[i].codepoint, glyphPos[i], output);
+			if (clusters != nullptr)
+			{
+				const bool unsafeToBreak = hb_glyph_info_get_glyph_flags(&glyphInfo[i]) & HB_GLYPH_FLAG_UNSAFE_TO_BREAK;
+				clusters->push_back({ glyphInfo[i].cluster, unsafeToBreak });
+			}
 		}
-
-		return glyphs;
 	}
 
-	ShapedGlyph TextShaper::GetShapedGlyph(const hb_glyph_info_t& glyphInfo, const hb_glyph_position_t& glyphPos)
+	void TextShaper::AddShapedGlyph(uint32_t glyphIndex, const hb_glyph_position_t& glyphPos, ShapedGlyphs& output)
 	{
-		unsigned int glyphIndex = glyphInfo.codepoint; // after shaping codepoint becomes glyph index
 		ShapedGlyph glyph{};
 		glyph.info = GetAtlasGlyph(glyphIndex);
 		glyph.xOffset = static_cast<float>(glyphPos.x_offset) / 64.0f;
 		glyph.yOffset = static_cast<float>(glyphPos.y_offset) / 64.0f;
 		glyph.xAdvance = static_cast<float>(glyphPos.x_advance) / 64.0f;
 		glyph.yAdvance = static_cast<float>(glyphPos.y_advance) / 64.0f;
-		return glyph;
+		output.push_back(glyph);
+	}
+
+	/**
+	* The index of the glyph returned by the atlas is stored, so a glyph missing from the atlas
+	* becomes the unknown glyph, as in ShapedGlyph::info.
+	*/
+	void TextShaper::AddShapedGlyph(uint32_t glyphIndex, const hb_glyph_position_t& glyphPos, ShapedText& output)
+	{
+		output.glyphIndices.push_back(GetAtlasGlyph(glyphIndex).glyphIndex);
+		output.xOffsets.push_back(static_cast<float>(glyphPos.x_offset) / 64.0f);
+		output.yOffsets.push_back(static_cast<float>(glyphPos.y_offset) / 64.0f);
+		output.xAdvances.push_back(static_cast<float>(glyphPos.x_advance) / 64.0f);
+		output.yAdvances.push_back(static_cast<float>(glyphPos.y_advance) / 64.0f);
+	}
+
+	void TextShaper::ShapeBuffer(size_t font)
+	{
+		// The face is a clone owned by this shaper, so shapers on other threads are never waited for
+		hb_shape(m_HarfBuzzFonts[font], m_Buffer, nullptr, 0);
 	}
 
 	void TextShaper::ResetBuffer()
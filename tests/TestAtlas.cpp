@@ -1,11 +1,19 @@
 
 #include <gtest/gtest.h>
 #include <fstream>
+#include <algorithm>
+#include <filesystem>
 #include "Trex/Atlas.hpp"
 
 using namespace testing;
 constexpr std::string_view fontPath = "fonts/Roboto-Regular.ttf";
 
+std::vector<Trex::Glyph> ToVector(const Trex::Atlas::Glyphs& glyphs)
+{
+	auto data = glyphs.Data();
+	return { data.begin(), data.end() };
+}
+
 TEST(AtlasConstructionTests, atlasShouldBeConstructibleFromFontPath)
 {
 	const char *pathToFont = fontPath.data();
@@ -65,6 +73,169 @@ TEST(AtlasConstructionTests, shouldBeAbleToSetPadding)
 	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, padding);
 }
 
+TEST(AtlasConstructionTests, shouldBeAbleToRasterizeGlyphsInParallel)
+{
+	const Trex::AtlasOptions options{ .threads = 4 };
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, options);
+	EXPECT_EQ(atlas.GetGlyphs().Size(), 895);
+}
+
+TEST(AtlasConstructionTests, parallelAtlasShouldBeIdenticalToSerialAtlas)
+{
+	const Trex::Atlas serialAtlas(fontPath.data(), 32);
+	const Trex::Atlas parallelAtlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, { .threads = 0 });
+
+	EXPECT_EQ(serialAtlas.GetBitmap().Data(), parallelAtlas.GetBitmap().Data());
+	EXPECT_EQ(ToVector(serialAtlas.GetGlyphs()), ToVector(parallelAtlas.GetGlyphs()));
+}
+
+TEST(AtlasConstructionTests, streamingBuildShouldBeIdenticalToRegularBuild)
+{
+	for (auto mode : { Trex::RenderMode::DEFAULT, Trex::RenderMode::SDF, Trex::RenderMode::LCD })
+	{
+		const Trex::AtlasOptions options{ .threads = 4, .streamingBuild = true };
+		Trex::Atlas regular(fontPath.data(), 32, Trex::Charset::Full(), mode);
+		Trex::Atlas streamed(fontPath.data(), 32, Trex::Charset::Full(), mode, 1, options);
+
+		EXPECT_EQ(streamed.GetBitmap().Data(), regular.GetBitmap().Data());
+		EXPECT_EQ(ToVector(streamed.GetGlyphs()), ToVector(regular.GetGlyphs()));
+		EXPECT_EQ(streamed.GetGlyphs().GetUnknownGlyph(), regular.GetGlyphs().GetUnknownGlyph());
+	}
+}
+
+TEST(AtlasConstructionTests, shouldBeAbleToUseSkylinePacking)
+{
+	const Trex::AtlasOptions options{ .packing = Trex::PackingMethod::SKYLINE };
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, options);
+	EXPECT_EQ(atlas.GetGlyphs().Size(), 895);
+	EXPECT_EQ(atlas.GetBitmap().Width(), 1024);
+	EXPECT_EQ(atlas.GetBitmap().Height(), 1024);
+}
+
+TEST(AtlasConstructionTests, skylinePackedGlyphsShouldNotOverlap)
+{
+	for (const auto method : { Trex::PackingMethod::SKYLINE, Trex::PackingMethod::SKYLINE_MIN_WASTE })
+	{
+		const Trex::AtlasOptions options{ .packing = method, .size = Trex::SizeConstraint::NONE };
+		constexpr int padding = 1;
+		Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, padding, options);
+		const auto& bitmap = atlas.GetBitmap();
+
+		std::vector<bool> used(bitmap.Width() * bitmap.Height(), false);
+		for (const Trex::Glyph& glyph : atlas.GetGlyphs().Data())
+		{
+			ASSERT_GE(glyph.x - padding, 0);
+			ASSERT_GE(glyph.y - padding, 0);
+			ASSERT_LE(glyph.x + glyph.width + padding, bitmap.Width());
+			ASSERT_LE(glyph.y + glyph.height + padding, bitmap.Height());
+			for (unsigned int y = glyph.y; y < glyph.y + glyph.height; ++y)
+			{
+				for (unsigned int x = glyph.x; x < glyph.x + glyph.width; ++x)
+				{
+					ASSERT_FALSE(used[y * bitmap.Width() + x]);
+					used[y * bitmap.Width() + x] = true;
+				}
+			}
+		}
+	}
+}
+
+TEST(AtlasConstructionTests, shouldShrinkAtlasWhenSizeIsNotConstrained)
+{
+	const Trex::AtlasOptions shelfOptions{ .size = Trex::SizeConstraint::POWER_OF_TWO };
+	const Trex::AtlasOptions skylineOptions{ .packing = Trex::PackingMethod::SKYLINE, .size = Trex::SizeConstraint::NONE };
+	Trex::Atlas shelfAtlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, shelfOptions);
+	Trex::Atlas skylineAtlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, skylineOptions);
+
+	EXPECT_EQ(shelfAtlas.GetBitmap().Width(), 1024);
+	EXPECT_EQ(shelfAtlas.GetBitmap().Height(), 1024);
+	EXPECT_LT(skylineAtlas.GetBitmap().Data().size(), shelfAtlas.GetBitmap().Data().size() / 2);
+}
+
+TEST(AtlasConstructionTests, shouldSpreadGlyphsAcrossPagesWhenAtlasExceedsMaxPageSize)
+{
+	const Trex::AtlasOptions options{ .maxPageSize = 256 };
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, options);
+
+	ASSERT_GT(atlas.GetBitmaps().size(), 1);
+	for (const auto& bitmap : atlas.GetBitmaps())
+	{
+		EXPECT_EQ(bitmap.Width(), 256);
+		EXPECT_EQ(bitmap.Height(), 256);
+	}
+	EXPECT_EQ(atlas.GetGlyphs().Size(), 895);
+
+	std::vector<std::vector<bool>> used(atlas.GetBitmaps().size(), std::vector<bool>(256 * 256, false));
+	for (const Trex::Glyph& glyph : atlas.GetGlyphs().Data())
+	{
+		ASSERT_LT(glyph.page, atlas.GetBitmaps().size());
+		ASSERT_LE(glyph.x + glyph.width, 256);
+		ASSERT_LE(glyph.y + glyph.height, 256);
+		for (unsigned int y = glyph.y; y < glyph.y + glyph.height; ++y)
+		{
+			for (unsigned int x = glyph.x; x < glyph.x + glyph.width; ++x)
+			{
+				ASSERT_FALSE(used[glyph.page][y * 256 + x]);
+				used[glyph.page][y * 256 + x] = true;
+			}
+		}
+	}
+}
+
+TEST(AtlasConstructionTests, shouldUseSinglePageWhenAtlasFitsIntoMaxPageSize)
+{
+	const Trex::AtlasOptions options{ .maxPageSize = 1024 };
+	Trex::Atlas limited(fontPath.data(), 32, Trex::Charset::Full(), Trex::RenderMode::DEFAULT, 1, options);
+	Trex::Atlas unlimited(fontPath.data(), 32, Trex::Charset::Full());
+
+	ASSERT_EQ(limited.GetBitmaps().size(), 1);
+	EXPECT_EQ(limited.GetBitmap().Data(), unlimited.GetBitmap().Data());
+	EXPECT_EQ(ToVector(limited.GetGlyphs()), ToVector(unlimited.GetGlyphs()));
+}
+
+TEST(AtlasConstructionTests, shouldThrowWhenGlyphIsLargerThanMaxPageSize)
+{
+	const Trex::AtlasOptions options{ .maxPageSize = 16 };
+	EXPECT_THROW(Trex::Atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, options), std::runtime_error);
+}
+
+TEST(AtlasConstructionTests, shouldRasterizeEachGlyphIndexOnce)
+{
+	// None of these codepoints is in the font, so all of them map to the glyph 0
+	const Trex::AtlasOptions options{ .size = Trex::SizeConstraint::NONE };
+	Trex::Atlas manyCodepoints(fontPath.data(), 32, Trex::Charset(0xE000, 0xE0FF), Trex::RenderMode::DEFAULT, 1, options);
+	Trex::Atlas singleCodepoint(fontPath.data(), 32, Trex::Charset(0xE000, 0xE000), Trex::RenderMode::DEFAULT, 1, options);
+
+	EXPECT_EQ(manyCodepoints.GetGlyphs().Size(), 1);
+	EXPECT_EQ(manyCodepoints.GetBitmap().Width(), singleCodepoint.GetBitmap().Width());
+	EXPECT_EQ(manyCodepoints.GetBitmap().Height(), singleCodepoint.GetBitmap().Height());
+}
+
+TEST(AtlasConstructionTests, shouldShareIdenticalBitmapsWhenDeduplicationIsEnabled)
+{
+	const Trex::Charset charset(std::vector<Trex::Charset::Range>{ { 'A', 'A' }, { 0x410, 0x410 } }); // Latin and Cyrillic A
+	const Trex::AtlasOptions options{ .deduplicateBitmaps = true };
+	Trex::Atlas atlas(fontPath.data(), 32, charset, Trex::RenderMode::DEFAULT, 1, options);
+
+	const Trex::Glyph& latin = atlas.GetGlyphs().GetGlyphByCodepoint('A');
+	const Trex::Glyph& cyrillic = atlas.GetGlyphs().GetGlyphByCodepoint(0x410);
+	ASSERT_NE(latin.glyphIndex, cyrillic.glyphIndex);
+	EXPECT_EQ(latin.x, cyrillic.x);
+	EXPECT_EQ(latin.y, cyrillic.y);
+	EXPECT_EQ(latin.width, cyrillic.width);
+	EXPECT_EQ(latin.height, cyrillic.height);
+}
+
+TEST(AtlasConstructionTests, shouldKeepDifferentBitmapsWhenDeduplicationIsEnabled)
+{
+	const Trex::AtlasOptions options{ .deduplicateBitmaps = true };
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, options);
+
+	const Trex::Glyph& a = atlas.GetGlyphs().GetGlyphByCodepoint('a');
+	const Trex::Glyph& b = atlas.GetGlyphs().GetGlyphByCodepoint('b');
+	EXPECT_FALSE(a.x == b.x && a.y == b.y);
+}
+
 struct AtlasTests : Test
 {
 	AtlasTests() = default;
@@ -90,21 +261,55 @@ struct AtlasGlyphsTests : Test
 TEST_F(AtlasGlyphsTests, shouldContainAllGlyphs)
 {
 	EXPECT_FALSE(glyphs.Empty());
-	EXPECT_EQ(glyphs.Data().size(), 895);
+	EXPECT_EQ(glyphs.Size(), 895);
+}
+
+TEST_F(AtlasGlyphsTests, dataShouldListPresentGlyphsOrderedByIndex)
+{
+	const std::vector<Trex::Glyph> data = ToVector(glyphs);
+	ASSERT_EQ(data.size(), glyphs.Size());
+	EXPECT_TRUE(std::ranges::is_sorted(data, {}, &Trex::Glyph::glyphIndex));
+	for (const Trex::Glyph& glyph : data)
+	{
+		ASSERT_TRUE(glyphs.Contains(glyph.glyphIndex));
+		ASSERT_EQ(glyphs.GetGlyphByIndex(glyph.glyphIndex), glyph);
+	}
+	EXPECT_FALSE(glyphs.Contains(std::numeric_limits<uint32_t>::max()));
+	EXPECT_EQ(glyphs.GetGlyphByIndex(std::numeric_limits<uint32_t>::max()), glyphs.GetUnknownGlyph());
+}
+
+TEST_F(AtlasGlyphsTests, glyphIndexOfCodepointShouldMatchFont)
+{
+	const auto font = atlas.GetFont();
+	// Codepoints in the charset, missing from the font and out of the Unicode range
+	for (uint32_t codepoint : { 0x20u, 0x41u, 0x15Au, 0x4E00u, 0x1F600u, 0x10FFFFu, 0x110000u })
+	{
+		EXPECT_EQ(glyphs.GetGlyphIndex(codepoint), font->GetGlyphIndex(codepoint));
+	}
 }
 
 TEST_F(AtlasGlyphsTests, shouldSetUnknownGlyph)
 {
 	constexpr uint32_t codepointOfUnknownGlyph = 97;
-	glyphs.SetUnknownGlyph(codepointOfUnknownGlyph);
-	EXPECT_EQ(glyphs.GetUnknownGlyph().codepoint, codepointOfUnknownGlyph);
+	atlas.SetUnknownGlyph(codepointOfUnknownGlyph);
+	EXPECT_EQ(atlas.GetGlyphs().GetUnknownGlyph().codepoint, codepointOfUnknownGlyph);
 }
 
 TEST_F(AtlasGlyphsTests, shouldNotSetUnknownGlyphWhenCodepointIsNotInCharset)
 {
 	constexpr uint32_t codepointOutOfCharset = 0x123456;
-	glyphs.SetUnknownGlyph(codepointOutOfCharset);
-	EXPECT_NE(glyphs.GetUnknownGlyph().codepoint, codepointOutOfCharset);
+	atlas.SetUnknownGlyph(codepointOutOfCharset);
+	EXPECT_NE(atlas.GetGlyphs().GetUnknownGlyph().codepoint, codepointOutOfCharset);
+}
+
+TEST_F(AtlasGlyphsTests, settingUnknownGlyphShouldNotChangeSharedGlyphs)
+{
+	const auto shared = atlas.GetSharedGlyphs();
+	const Trex::Glyph unknownGlyph = shared->GetUnknownGlyph();
+	atlas.SetUnknownGlyph('a');
+
+	EXPECT_EQ(shared->GetUnknownGlyph(), unknownGlyph);
+	EXPECT_EQ(atlas.GetGlyphs().GetUnknownGlyph().codepoint, 'a');
 }
 
 TEST_F(AtlasGlyphsTests, shouldGetGlyphByCodepoint)
@@ -159,3 +364,336 @@ TEST_F(AtlasBitmapTests, shouldGetBitmapHeight)
 	const unsigned int height = bitmap.Height();
 	EXPECT_EQ(height, 1024);
 }
+
+struct AtlasCacheTests : Test
+{
+	AtlasCacheTests() { std::filesystem::remove(cachePath); }
+	~AtlasCacheTests() override { std::filesystem::remove(cachePath); }
+
+	const std::string cachePath = (std::filesystem::temp_directory_path() / "TrexTestAtlasCache.bin").string();
+};
+
+TEST_F(AtlasCacheTests, shouldBuildAtlasAndWriteCache)
+{
+	const Trex::Atlas cached = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+	const Trex::Atlas built(fontPath.data(), 32, Trex::Charset::Ascii());
+
+	EXPECT_TRUE(std::filesystem::exists(cachePath));
+	EXPECT_EQ(cached.GetBitmap().Data(), built.GetBitmap().Data());
+	EXPECT_EQ(ToVector(cached.GetGlyphs()), ToVector(built.GetGlyphs()));
+}
+
+TEST_F(AtlasCacheTests, shouldLoadAtlasFromCache)
+{
+	const Trex::Atlas built = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+	{
+		// Change the last pixel, so it is visible whether the atlas was loaded or built again
+		std::fstream file(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(-1, std::ios::end);
+		file.put(static_cast<char>(built.GetBitmap().Data().back() ^ 0xFF));
+	}
+
+	const Trex::Atlas loaded = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+
+	EXPECT_EQ(ToVector(loaded.GetGlyphs()), ToVector(built.GetGlyphs()));
+	EXPECT_EQ(loaded.GetGlyphs().GetUnknownGlyph(), built.GetGlyphs().GetUnknownGlyph());
+	ASSERT_EQ(loaded.GetBitmap().Data().size(), built.GetBitmap().Data().size());
+	EXPECT_EQ(loaded.GetBitmap().Data().back(), built.GetBitmap().Data().back() ^ 0xFF);
+}
+
+TEST_F(AtlasCacheTests, shouldLoadGlyphOfEveryCodepointFromCache)
+{
+	// Control codepoints 0x7F-0x9F are missing from the font and share its notdef glyph
+	const Trex::Charset charset(0x20, 0xFF);
+	const Trex::Atlas built = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, charset);
+	const Trex::Atlas loaded = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, charset);
+
+	for (uint32_t codepoint : charset)
+	{
+		EXPECT_EQ(loaded.GetGlyphs().GetGlyphIndex(codepoint), built.GetGlyphs().GetGlyphIndex(codepoint));
+		EXPECT_EQ(loaded.GetGlyphs().GetGlyphByCodepoint(codepoint), built.GetGlyphs().GetGlyphByCodepoint(codepoint));
+	}
+}
+
+TEST_F(AtlasCacheTests, shouldBuildAtlasAgainWhenInputsChange)
+{
+	Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+
+	const Trex::Atlas cached = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 24, Trex::Charset::Ascii(), Trex::RenderMode::SDF, 2);
+	const Trex::Atlas built(fontPath.data(), 24, Trex::Charset::Ascii(), Trex::RenderMode::SDF, 2);
+
+	EXPECT_EQ(cached.GetBitmap().Data(), built.GetBitmap().Data());
+	EXPECT_EQ(ToVector(cached.GetGlyphs()), ToVector(built.GetGlyphs()));
+}
+
+TEST_F(AtlasCacheTests, shouldBuildAtlasAgainWhenCacheIsInvalid)
+{
+	std::ofstream(cachePath, std::ios::binary) << "not an atlas";
+
+	const Trex::Atlas cached = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+	const Trex::Atlas built(fontPath.data(), 32, Trex::Charset::Ascii());
+
+	EXPECT_EQ(cached.GetBitmap().Data(), built.GetBitmap().Data());
+	EXPECT_GT(std::filesystem::file_size(cachePath), built.GetBitmap().Data().size());
+}
+
+TEST_F(AtlasCacheTests, shouldBuildAtlasAgainWhenGlyphIsOutsideOfBitmap)
+{
+	const Trex::Atlas built = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+	{
+		// Move the last glyph out of the bitmap and change the last pixel, so a loaded atlas would be visible
+		const auto bitmapSize = static_cast<std::streamoff>(built.GetBitmap().Data().size());
+		Trex::Glyph glyph = ToVector(built.GetGlyphs()).back();
+		glyph.x = static_cast<int>(built.GetBitmap().Width());
+		std::fstream file(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(-bitmapSize - static_cast<std::streamoff>(sizeof(glyph)), std::ios::end);
+		file.write(reinterpret_cast<const char*>(&glyph), sizeof(glyph));
+		file.seekp(-1, std::ios::end);
+		file.put(static_cast<char>(built.GetBitmap().Data().back() ^ 0xFF));
+	}
+
+	const Trex::Atlas cached = Trex::Atlas::LoadOrBuild(cachePath, fontPath.data(), 32, Trex::Charset::Ascii());
+
+	EXPECT_EQ(cached.GetBitmap().Data(), built.GetBitmap().Data());
+	EXPECT_EQ(ToVector(cached.GetGlyphs()), ToVector(built.GetGlyphs()));
+}
+
+TEST_F(AtlasCacheTests, shouldThrowWhenDynamicAtlasIsCached)
+{
+	const Trex::AtlasOptions options{ .atlasMode = Trex::AtlasMode::DYNAMIC };
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, options);
+	EXPECT_THROW(atlas.SaveCache(cachePath), std::runtime_error);
+}
+
+struct DynamicAtlasTests : Test
+{
+	static constexpr Trex::AtlasOptions options{ .atlasMode = Trex::AtlasMode::DYNAMIC };
+	Trex::Atlas atlas{ fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, options };
+};
+
+TEST_F(DynamicAtlasTests, shouldBeDynamic)
+{
+	EXPECT_TRUE(atlas.IsDynamic());
+	EXPECT_FALSE(Trex::Atlas(fontPath.data(), 32, Trex::Charset::Ascii()).IsDynamic());
+}
+
+TEST_F(DynamicAtlasTests, shouldAddMissingGlyphOnFirstUse)
+{
+	constexpr uint32_t codepoint = 0x15A; // Ś
+	const uint32_t glyphIndex = atlas.GetFont()->GetGlyphIndex(codepoint);
+	ASSERT_FALSE(atlas.GetGlyphs().Contains(glyphIndex));
+	atlas.TakeDirtyRegions();
+
+	const Trex::Glyph& glyph = atlas.LoadGlyphByCodepoint(codepoint);
+
+	EXPECT_TRUE(atlas.GetGlyphs().Contains(glyphIndex));
+	EXPECT_EQ(glyph.codepoint, codepoint);
+	EXPECT_EQ(glyph.glyphIndex, glyphIndex);
+	const std::vector<Trex::AtlasRegion> expected = { { glyph.x, glyph.y, glyph.width, glyph.height } };
+	EXPECT_EQ(atlas.TakeDirtyRegions(), expected);
+	EXPECT_TRUE(atlas.TakeDirtyRegions().empty());
+}
+
+TEST_F(DynamicAtlasTests, shouldRenderAddedGlyphLikeStaticAtlas)
+{
+	const Trex::Atlas staticAtlas(fontPath.data(), 32, Trex::Charset(0x15A, 0x15A));
+	const Trex::Glyph& expected = staticAtlas.GetGlyphs().GetGlyphByCodepoint(0x15A);
+	const Trex::Glyph& actual = atlas.LoadGlyphByIndex(expected.glyphIndex);
+
+	ASSERT_EQ(actual.width, expected.width);
+	ASSERT_EQ(actual.height, expected.height);
+	EXPECT_EQ(actual.bearingX, expected.bearingX);
+	EXPECT_EQ(actual.bearingY, expected.bearingY);
+	for (unsigned int y = 0; y < actual.height; ++y)
+	{
+		for (unsigned int x = 0; x < actual.width; ++x)
+		{
+			const auto actualPixel = atlas.GetBitmap().Data()[(actual.y + y) * atlas.GetBitmap().Width() + actual.x + x];
+			const auto expectedPixel = staticAtlas.GetBitmap().Data()[(expected.y + y) * staticAtlas.GetBitmap().Width() + expected.x + x];
+			ASSERT_EQ(actualPixel, expectedPixel);
+		}
+	}
+}
+
+TEST_F(DynamicAtlasTests, shouldGrowBitmapWhenThereIsNoFreeSpace)
+{
+	const unsigned int width = atlas.GetBitmap().Width();
+	const unsigned int height = atlas.GetBitmap().Height();
+	const Trex::Glyph glyphA = atlas.GetGlyphs().GetGlyphByCodepoint('A');
+
+	for (uint32_t codepoint = 0x100; codepoint < 0x250; ++codepoint)
+	{
+		atlas.LoadGlyphByCodepoint(codepoint);
+	}
+
+	EXPECT_EQ(atlas.GetBitmap().Width(), width);
+	EXPECT_GT(atlas.GetBitmap().Height(), height);
+	EXPECT_EQ(atlas.GetGlyphs().GetGlyphByCodepoint('A'), glyphA);
+	const std::vector<Trex::AtlasRegion> expected = { { 0, 0, atlas.GetBitmap().Width(), atlas.GetBitmap().Height() } };
+	EXPECT_EQ(atlas.TakeDirtyRegions(), expected);
+}
+
+TEST_F(DynamicAtlasTests, shouldNotAddGlyphToStaticAtlas)
+{
+	Trex::Atlas staticAtlas(fontPath.data(), 32, Trex::Charset::Ascii());
+	const Trex::Glyph& glyph = staticAtlas.LoadGlyphByCodepoint(0x15A);
+	EXPECT_EQ(glyph, staticAtlas.GetGlyphs().GetUnknownGlyph());
+	EXPECT_TRUE(staticAtlas.TakeDirtyRegions().empty());
+}
+
+TEST_F(DynamicAtlasTests, copiedAtlasShouldNotShareAddedGlyphs)
+{
+	Trex::Atlas copy = atlas;
+	copy.LoadGlyphByCodepoint(0x15A);
+	atlas.LoadGlyphByCodepoint(0x15B);
+
+	EXPECT_TRUE(copy.GetGlyphs().Contains(copy.GetFont()->GetGlyphIndex(0x15A)));
+	EXPECT_FALSE(atlas.GetGlyphs().Contains(atlas.GetFont()->GetGlyphIndex(0x15A)));
+}
+
+TEST_F(DynamicAtlasTests, sharedGlyphTableShouldNotChangeWhenGlyphIsAdded)
+{
+	const std::shared_ptr<const Trex::Atlas::Glyphs> shared = atlas.GetSharedGlyphs();
+	EXPECT_EQ(shared.get(), &atlas.GetGlyphs());
+
+	atlas.LoadGlyphByCodepoint(0x15A);
+	const uint32_t glyphIndex = atlas.GetFont()->GetGlyphIndex(0x15A);
+	EXPECT_NE(shared.get(), &atlas.GetGlyphs());
+	EXPECT_FALSE(shared->Contains(glyphIndex));
+	EXPECT_TRUE(atlas.GetGlyphs().Contains(glyphIndex));
+}
+
+TEST_F(DynamicAtlasTests, shouldAddPageWhenMaxPageSizeIsReached)
+{
+	const Trex::AtlasOptions pagedOptions{ .atlasMode = Trex::AtlasMode::DYNAMIC, .maxPageSize = 256 };
+	Trex::Atlas pagedAtlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, pagedOptions);
+	pagedAtlas.TakeDirtyRegions();
+
+	for (uint32_t codepoint = 0x100; codepoint < 0x250; ++codepoint)
+	{
+		pagedAtlas.LoadGlyphByCodepoint(codepoint);
+	}
+
+	ASSERT_GT(pagedAtlas.GetBitmaps().size(), 1);
+	for (const auto& bitmap : pagedAtlas.GetBitmaps())
+	{
+		EXPECT_LE(bitmap.Width(), 256);
+		EXPECT_LE(bitmap.Height(), 256);
+	}
+	const auto& lastPage = pagedAtlas.GetBitmaps().back();
+	const auto lastPageIndex = static_cast<unsigned int>(pagedAtlas.GetBitmaps().size() - 1);
+	const Trex::AtlasRegion wholeLastPage{ 0, 0, lastPage.Width(), lastPage.Height(), lastPageIndex };
+	const auto dirtyRegions = pagedAtlas.TakeDirtyRegions();
+	EXPECT_NE(std::ranges::find(dirtyRegions, wholeLastPage), dirtyRegions.end());
+}
+
+struct CacheAtlasTests : Test
+{
+	static constexpr Trex::AtlasOptions options{ .atlasMode = Trex::AtlasMode::CACHE, .width = 512, .height = 256 };
+	Trex::Atlas atlas{ fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, options };
+
+	void LoadManyGlyphs(uint32_t keptCodepoint = 0)
+	{
+		for (uint32_t codepoint = 0x100; codepoint < 0x250; ++codepoint)
+		{
+			atlas.LoadGlyphByCodepoint(codepoint);
+			if (keptCodepoint != 0)
+			{
+				atlas.LoadGlyphByCodepoint(keptCodepoint);
+			}
+		}
+	}
+};
+
+TEST_F(CacheAtlasTests, shouldBeDynamicCache)
+{
+	EXPECT_TRUE(atlas.IsDynamic());
+	EXPECT_TRUE(atlas.IsCache());
+	EXPECT_FALSE(Trex::Atlas(fontPath.data(), 32, Trex::Charset::Ascii()).IsCache());
+}
+
+TEST_F(CacheAtlasTests, shouldKeepFixedSize)
+{
+	LoadManyGlyphs();
+
+	EXPECT_EQ(atlas.GetBitmap().Width(), 512);
+	EXPECT_EQ(atlas.GetBitmap().Height(), 256);
+}
+
+TEST_F(CacheAtlasTests, shouldEvictLeastRecentlyUsedGlyphs)
+{
+	const auto& font = *atlas.GetFont();
+	LoadManyGlyphs(0x15A);
+
+	EXPECT_TRUE(atlas.GetGlyphs().Contains(font.GetGlyphIndex(0x15A)));
+	EXPECT_TRUE(atlas.GetGlyphs().Contains(font.GetGlyphIndex(0x24F)));
+	EXPECT_FALSE(atlas.GetGlyphs().Contains(font.GetGlyphIndex(0x100)));
+}
+
+TEST_F(CacheAtlasTests, evictedGlyphRegionShouldBeDirty)
+{
+	const Trex::Glyph evicted = atlas.LoadGlyphByCodepoint(0x100);
+	atlas.TakeDirtyRegions();
+	LoadManyGlyphs();
+
+	EXPECT_FALSE(atlas.GetGlyphs().Contains(evicted.glyphIndex));
+	EXPECT_EQ(evicted.glyphIndex, atlas.GetFont()->GetGlyphIndex(0x100)); // The returned copy is unchanged
+	const Trex::AtlasRegion region{ evicted.x, evicted.y, evicted.width, evicted.height, evicted.page };
+	const auto dirtyRegions = atlas.TakeDirtyRegions();
+	EXPECT_NE(std::ranges::find(dirtyRegions, region), dirtyRegions.end());
+}
+
+TEST_F(CacheAtlasTests, shouldNotEvictGlyphsOfInitialCharset)
+{
+	const Trex::Glyph glyphA = atlas.GetGlyphs().GetGlyphByCodepoint('A');
+	LoadManyGlyphs();
+
+	for (uint32_t codepoint = 0x20; codepoint < 0x7F; ++codepoint)
+	{
+		EXPECT_TRUE(atlas.GetGlyphs().Contains(atlas.GetFont()->GetGlyphIndex(codepoint)));
+	}
+	EXPECT_EQ(atlas.GetGlyphs().GetGlyphByCodepoint('A'), glyphA);
+}
+
+TEST_F(CacheAtlasTests, cachedGlyphsShouldNotOverlap)
+{
+	LoadManyGlyphs(0x15A);
+
+	const std::vector<Trex::Glyph> glyphs = ToVector(atlas.GetGlyphs());
+	for (size_t i = 0; i < glyphs.size(); ++i)
+	{
+		const auto& a = glyphs[i];
+		ASSERT_LE(a.x + a.width, atlas.GetBitmap().Width());
+		ASSERT_LE(a.y + a.height, atlas.GetBitmap().Height());
+		for (size_t j = i + 1; j < glyphs.size(); ++j)
+		{
+			const auto& b = glyphs[j];
+			const bool separated = a.x + (int)a.width <= b.x || b.x + (int)b.width <= a.x ||
+				a.y + (int)a.height <= b.y || b.y + (int)b.height <= a.y;
+			ASSERT_TRUE(separated) << "Glyphs " << a.glyphIndex << " and " << b.glyphIndex << " overlap";
+		}
+	}
+}
+
+TEST_F(CacheAtlasTests, shouldNotEvictGlyphsForGlyphThatCannotFit)
+{
+	constexpr Trex::AtlasOptions narrowCache{ .atlasMode = Trex::AtlasMode::CACHE, .width = 24, .height = 64 };
+	Trex::Atlas narrowAtlas(fontPath.data(), 32, Trex::Charset('-', '.'), Trex::RenderMode::DEFAULT, 1, narrowCache);
+	const auto& font = *narrowAtlas.GetFont();
+	narrowAtlas.LoadGlyphByCodepoint('_');
+	narrowAtlas.LoadGlyphByCodepoint('~');
+	narrowAtlas.TakeDirtyRegions();
+
+	narrowAtlas.LoadGlyphByCodepoint('W'); // Wider than the whole cache
+
+	EXPECT_FALSE(narrowAtlas.GetGlyphs().Contains(font.GetGlyphIndex('W')));
+	EXPECT_TRUE(narrowAtlas.GetGlyphs().Contains(font.GetGlyphIndex('_')));
+	EXPECT_TRUE(narrowAtlas.GetGlyphs().Contains(font.GetGlyphIndex('~')));
+	EXPECT_TRUE(narrowAtlas.TakeDirtyRegions().empty());
+}
+
+TEST_F(CacheAtlasTests, shouldThrowWhenInitialCharsetDoesNotFit)
+{
+	constexpr Trex::AtlasOptions smallCache{ .atlasMode = Trex::AtlasMode::CACHE, .width = 64, .height = 64 };
+	EXPECT_THROW(Trex::Atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, smallCache), std::runtime_error);
+}
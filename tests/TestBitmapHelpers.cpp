@@ -1,5 +1,6 @@
 #include "Trex/BitmapHelpers.hpp"
 #include <gtest/gtest.h>
+#include <stdexcept>
 #include <vector>
 
 struct BitmapHelpersTests : public ::testing::Test
@@ -31,3 +32,40 @@ TEST_F(BitmapHelpersTests, ConvertBitmapToRGBA)
 	const auto actual = Trex::ConvertBitmapToRGBA(bitmap);
 	EXPECT_EQ(expected, actual);
 }
+
+TEST_F(BitmapHelpersTests, ConvertIntoOutputSpanShouldMatchReturnedBitmap)
+{
+	// Long enough for the vectorized loops and a scalar tail
+	std::vector<uint8_t> largeBitmap(1000 + 7);
+	for (size_t i = 0; i < largeBitmap.size(); i++)
+		largeBitmap[i] = static_cast<uint8_t>(i * 31);
+
+	std::vector<uint8_t> grayAlpha(largeBitmap.size() * 2);
+	Trex::ConvertBitmapToGrayAlpha(largeBitmap, grayAlpha);
+	std::vector<uint8_t> rgb(largeBitmap.size() * 3);
+	Trex::ConvertBitmapToRGB(largeBitmap, rgb);
+	std::vector<uint8_t> rgba(largeBitmap.size() * 4);
+	Trex::ConvertBitmapToRGBA(largeBitmap, rgba);
+
+	for (size_t i = 0; i < largeBitmap.size(); i++)
+	{
+		const uint8_t gray = largeBitmap[i];
+		ASSERT_EQ(grayAlpha[i * 2], gray);
+		ASSERT_EQ(grayAlpha[i * 2 + 1], 255);
+		ASSERT_EQ(rgb[i * 3], gray);
+		ASSERT_EQ(rgb[i * 3 + 1], gray);
+		ASSERT_EQ(rgb[i * 3 + 2], gray);
+		ASSERT_EQ(rgba[i * 4], gray);
+		ASSERT_EQ(rgba[i * 4 + 1], gray);
+		ASSERT_EQ(rgba[i * 4 + 2], gray);
+		ASSERT_EQ(rgba[i * 4 + 3], 255);
+	}
+	EXPECT_EQ(rgba, Trex::ConvertBitmapToRGBA(largeBitmap));
+}
+
+TEST_F(BitmapHelpersTests, ConvertIntoTooSmallOutputShouldThrow)
+{
+	std::vector<uint8_t> output(bitmap.size() * 3);
+	EXPECT_THROW(Trex::ConvertBitmapToRGBA(bitmap, output), std::runtime_error);
+	EXPECT_NO_THROW(Trex::ConvertBitmapToRGB(bitmap, output));
+}
@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <set>
+#include <vector>
 #include "Trex/Atlas.hpp"
 
 
@@ -96,4 +99,56 @@ TEST_F(CharsetTests, shouldBeIterableOverCodepoints)
 		codepoints.insert(codepoint);
 	}
 	EXPECT_EQ(codepoints, charset.Codepoints());
+}
+
+TEST_F(CharsetTests, shouldIterateOverAllRangesInOrder)
+{
+	const Trex::Charset charset({ {10, 12}, {0, 1}, {20, 20} });
+	const std::vector<uint32_t> codepoints(charset.begin(), charset.end());
+	EXPECT_EQ(codepoints, (std::vector<uint32_t>{ 0, 1, 10, 11, 12, 20 }));
+}
+
+TEST_F(CharsetTests, shouldMergeOverlappingAndAdjacentRanges)
+{
+	const Trex::Charset charset({ {100, 200}, {0, 10}, {150, 300}, {11, 20}, {0xFFFFFFF0, 0xFFFFFFFF} });
+	const std::vector<Trex::Charset::Range> expected = { {0, 20}, {100, 300}, {0xFFFFFFF0, 0xFFFFFFFF} };
+	EXPECT_TRUE(std::ranges::equal(charset.Ranges(), expected));
+	EXPECT_EQ(charset.Size(), 21 + 201 + 16);
+}
+
+TEST_F(CharsetTests, addedCodepointsShouldJoinRanges)
+{
+	Trex::Charset charset(10, 20);
+	charset.AddCodepoint(22);
+	charset.AddCodepoint(21);
+	charset.AddCodepoint(9);
+	charset.AddCodepoint(5);
+	const std::vector<Trex::Charset::Range> expected = { {5, 5}, {9, 22} };
+	EXPECT_TRUE(std::ranges::equal(charset.Ranges(), expected));
+	EXPECT_EQ(charset.Size(), 15);
+	EXPECT_TRUE(charset.Contains(15));
+	EXPECT_FALSE(charset.Contains(6));
+	EXPECT_FALSE(charset.Contains(23));
+}
+
+TEST_F(CharsetTests, shouldSupportSetAlgebra)
+{
+	const Trex::Charset latin(0, 0x24F);
+	const Trex::Charset cyrillicAndLatin({ {0, 0x7F}, {0x400, 0x4FF} });
+
+	EXPECT_EQ(latin.Union(cyrillicAndLatin), Trex::Charset({ {0, 0x24F}, {0x400, 0x4FF} }));
+	EXPECT_EQ(latin.Intersection(cyrillicAndLatin), Trex::Charset::Ascii());
+	EXPECT_EQ(latin.Difference(cyrillicAndLatin), Trex::Charset(0x80, 0x24F));
+	EXPECT_EQ(cyrillicAndLatin.Difference(Trex::Charset({ {0x10, 0x1F}, {0x450, 0x1000} })),
+		Trex::Charset({ {0, 0xF}, {0x20, 0x7F}, {0x400, 0x44F} }));
+	EXPECT_EQ(latin.Difference(latin).Size(), 0);
+}
+
+TEST_F(CharsetTests, fullCharsetShouldAbsorbOtherCharsetsInSetAlgebra)
+{
+	const Trex::Charset ascii = Trex::Charset::Ascii();
+	EXPECT_TRUE(ascii.Union(Trex::Charset::Full()).IsFull());
+	EXPECT_EQ(Trex::Charset::Full().Intersection(ascii), ascii);
+	EXPECT_EQ(ascii.Difference(Trex::Charset::Full()).Size(), 0);
+	EXPECT_THROW(Trex::Charset::Full().Difference(ascii), std::runtime_error);
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include "Trex/CharsetBuilder.hpp"
+#include "Trex/Font.hpp"
+
+using namespace testing;
+constexpr std::string_view fontPath = "fonts/Roboto-Regular.ttf";
+
+TEST(CharsetBuilderTests, shouldCollectCodepointsOfUtf8Text)
+{
+	Trex::CharsetBuilder builder;
+	builder.AddUtf8(std::string("Zażółć gęślą jaźń"));
+	builder.AddUtf8(std::string("Привет 😀"));
+
+	const Trex::Charset charset = builder.Build();
+	for (uint32_t codepoint : std::initializer_list<uint32_t>{ 'Z', 'a', ' ', 0x17C, 0xF3, 0x142, 0x107, 0x119, 0x15B, 0x105, 0x17A, 0x144, 0x41F, 0x1F600 })
+	{
+		EXPECT_TRUE(charset.Contains(codepoint)) << codepoint;
+	}
+	EXPECT_EQ(charset.Size(), 22);
+}
+
+TEST(CharsetBuilderTests, shouldThrowWhenTextIsNotValidUtf8)
+{
+	// Stray continuation byte, overlong form, surrogate, above U+10FFFF and a truncated sequence
+	for (std::string text : { "a\x80", "\xC0\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "abc\xE2\x82" })
+	{
+		Trex::CharsetBuilder builder;
+		EXPECT_THROW(builder.AddUtf8(text), std::runtime_error);
+	}
+}
+
+TEST(CharsetBuilderTests, invalidTextShouldNotChangeBuilder)
+{
+	Trex::CharsetBuilder builder;
+	builder.AddUtf8(std::string("a"));
+	EXPECT_THROW(builder.AddUtf8(std::string("b\xC3\xA9\x80")), std::runtime_error);
+	EXPECT_EQ(builder.Build(), Trex::Charset('a', 'a'));
+}
+
+TEST(CharsetBuilderTests, invalidBytesAtChunkBoundaryShouldBeRejectedByAnyThreadCount)
+{
+	// Stray continuation bytes right at the boundary of two chunks of 2 threads
+	for (const std::string_view stray : { "\x80", "\x80\x80\x80\x80\x80", "\xC3\xA9\x80" })
+	{
+		std::string text(2 << 20, 'a');
+		text.replace(text.size() / 2, stray.size(), stray);
+		for (unsigned int threads : { 1u, 2u, 4u })
+		{
+			Trex::CharsetBuilder builder(threads);
+			EXPECT_THROW(builder.AddUtf8(text), std::runtime_error) << threads;
+			EXPECT_EQ(builder.Build().Size(), 0) << threads;
+		}
+	}
+}
+
+TEST(CharsetBuilderTests, threadedScanShouldFindTheSameCodepoints)
+{
+	// Large enough to be split between threads, with multibyte codepoints around the chunk boundaries
+	std::string text;
+	for (int i = 0; i < 200'000; ++i)
+	{
+		text += "Lorem ipsum ";
+		text += i % 1000 == 0 ? "漢字 " : "ąę ";
+	}
+	text += "\U0001F600";
+
+	Trex::CharsetBuilder serial(1);
+	serial.AddUtf8(text);
+	Trex::CharsetBuilder threaded(4);
+	threaded.AddUtf8(text);
+	EXPECT_EQ(threaded.Build(), serial.Build());
+	EXPECT_TRUE(threaded.Build().Contains(0x1F600));
+}
+
+TEST(CharsetBuilderTests, shouldBuildCharsetIntersectedWithFont)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "trex_corpus.txt").string();
+	{
+		std::ofstream file(path, std::ios::binary);
+		file << "Hello, world! \xE6\xBC\xA2"; // The CJK ideograph is missing from the font
+	}
+
+	Trex::CharsetBuilder builder;
+	builder.AddUtf8File(path);
+	std::filesystem::remove(path);
+
+	const Trex::Font font(fontPath.data());
+	const Trex::Charset charset = builder.Build(font);
+	EXPECT_TRUE(builder.Build().Contains(0x6F22));
+	EXPECT_FALSE(charset.Contains(0x6F22));
+	EXPECT_EQ(charset, Trex::Charset({ {' ', ' '}, {'!', '!'}, {',', ','}, {'H', 'H'}, {'d', 'e'}, {'l', 'l'}, {'o', 'o'}, {'r', 'r'}, {'w', 'w'} }));
+}
@@ -27,6 +27,19 @@ TEST(FontConstructionTests, fontShouldBeConstructibleFromArrayOfChars)
 	Trex::Font font(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(data.data()), data.size()));
 }
 
+TEST(FontConstructionTests, fontShouldBeConstructibleFromBorrowedData)
+{
+	std::ifstream file(fontPath.data(), std::ios::binary);
+	const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const Trex::Font borrowed(data, Trex::DataOwnership::BORROW);
+	const Trex::Font clone = borrowed.Clone();
+	const Trex::Font mapped(fontPath.data());
+	EXPECT_EQ(borrowed.GetGlyphIndex('A'), mapped.GetGlyphIndex('A'));
+	EXPECT_EQ(clone.GetGlyphIndex('A'), mapped.GetGlyphIndex('A'));
+	EXPECT_EQ(borrowed.GetContentHash(), mapped.GetContentHash());
+	EXPECT_EQ(Trex::Font(data).GetContentHash(), mapped.GetContentHash());
+}
+
 TEST(FontConstructionTests, shouldThrowWhenFontPathIsInvalid)
 {
 	const char *path = "invalid/path";
@@ -57,6 +70,16 @@ TEST_F(FontTests, faceShouldNotBeNullptr)
 	EXPECT_NE(font.face, nullptr);
 }
 
+TEST_F(FontTests, shouldCloneFontWithItsOwnFace)
+{
+	font.SetSize(Trex::Pixels{ 24 });
+	const Trex::Font clone = font.Clone();
+	EXPECT_NE(clone.face, nullptr);
+	EXPECT_NE(clone.face, font.face);
+	EXPECT_EQ(clone.GetGlyphIndex('A'), font.GetGlyphIndex('A'));
+	EXPECT_EQ(clone.GetMetrics().height, font.GetMetrics().height);
+}
+
 TEST_F(FontTests, shouldChangeSizeInPixels)
 {
 	font.SetSize(Trex::Pixels{ 12 });
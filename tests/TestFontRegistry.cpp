@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <filesystem>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <thread>
+#include "Trex/FontRegistry.hpp"
+#include "Trex/Atlas.hpp"
+
+using namespace testing;
+constexpr std::string_view fontPath = "fonts/Roboto-Regular.ttf";
+
+namespace
+{
+	std::vector<uint8_t> ReadFontFile(std::string_view path = fontPath)
+	{
+		std::ifstream file(path.data(), std::ios::binary);
+		return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	}
+
+	void WriteUint32(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			data[offset + i] = static_cast<uint8_t>(value >> (24 - i * 8));
+		}
+	}
+
+	uint32_t ReadUint32(const std::vector<uint8_t>& data, size_t offset)
+	{
+		return uint32_t{ data[offset] } << 24 | uint32_t{ data[offset + 1] } << 16 | uint32_t{ data[offset + 2] } << 8 | data[offset + 3];
+	}
+
+	// TrueType collection made of whole font files. Table offsets of every font are moved to the position of the font.
+	std::vector<uint8_t> BuildFontCollection(const std::vector<std::vector<uint8_t>>& fonts)
+	{
+		std::vector<uint8_t> collection(12 + 4 * fonts.size());
+		const uint8_t header[] = { 't', 't', 'c', 'f', 0, 1, 0, 0 };
+		std::copy(std::begin(header), std::end(header), collection.begin());
+		WriteUint32(collection, 8, static_cast<uint32_t>(fonts.size()));
+		for (size_t i = 0; i < fonts.size(); ++i)
+		{
+			collection.resize((collection.size() + 3) / 4 * 4);
+			const size_t fontOffset = collection.size();
+			WriteUint32(collection, 12 + 4 * i, static_cast<uint32_t>(fontOffset));
+			collection.insert(collection.end(), fonts[i].begin(), fonts[i].end());
+
+			const size_t tableCount = size_t{ fonts[i][4] } << 8 | fonts[i][5];
+			for (size_t table = 0; table < tableCount; ++table)
+			{
+				const size_t offsetField = fontOffset + 12 + table * 16 + 8;
+				WriteUint32(collection, offsetField, ReadUint32(collection, offsetField) + static_cast<uint32_t>(fontOffset));
+			}
+		}
+		return collection;
+	}
+}
+
+TEST(FontRegistryTests, fontsOfSameFileShouldShareFace)
+{
+	Trex::FontRegistry registry;
+	const auto first = registry.Get(std::string(fontPath));
+	const auto second = registry.Get("fonts/../fonts/Roboto-Regular.ttf");
+	EXPECT_NE(first, second);
+	EXPECT_EQ(first->face, second->face);
+	EXPECT_EQ(registry.FaceCount(), 1);
+}
+
+TEST(FontRegistryTests, fontsOfSameDataShouldShareFace)
+{
+	Trex::FontRegistry registry;
+	const auto data = ReadFontFile();
+	const auto copy = data;
+	const auto first = registry.Get(data);
+	const auto second = registry.Get(copy);
+	EXPECT_EQ(first->face, second->face);
+	EXPECT_EQ(first->GetContentHash(), Trex::Font(fontPath.data()).GetContentHash());
+}
+
+TEST(FontRegistryTests, borrowedDataShouldNotShareFaceWithOtherBuffers)
+{
+	Trex::FontRegistry registry;
+	const auto data = ReadFontFile();
+	const auto copy = data;
+	const auto borrowed = registry.Get(data, 0, Trex::DataOwnership::BORROW);
+	EXPECT_EQ(registry.Get(data, 0, Trex::DataOwnership::BORROW)->face, borrowed->face);
+	EXPECT_NE(registry.Get(copy, 0, Trex::DataOwnership::BORROW)->face, borrowed->face);
+	EXPECT_NE(registry.Get(data)->face, borrowed->face);
+}
+
+TEST(FontRegistryTests, shouldReleaseFaceWhenLastFontIsDestroyed)
+{
+	Trex::FontRegistry registry;
+	auto font = registry.Get(std::string(fontPath));
+	EXPECT_EQ(registry.FaceCount(), 1);
+	font.reset();
+	EXPECT_EQ(registry.FaceCount(), 0);
+}
+
+TEST(FontRegistryTests, shouldPruneSourcesWithoutFaces)
+{
+	Trex::FontRegistry registry;
+	for (int i = 0; i < 8; ++i)
+	{
+		const auto data = ReadFontFile();
+		registry.Get(data, 0, Trex::DataOwnership::BORROW);
+		registry.Get(std::string(fontPath));
+	}
+	const auto font = registry.Get(std::string(fontPath));
+	EXPECT_EQ(registry.SourceCount(), 1);
+	EXPECT_EQ(registry.FaceCount(), 1);
+}
+
+TEST(FontRegistryTests, fontsSharingFaceShouldKeepTheirOwnSize)
+{
+	Trex::FontRegistry registry;
+	const auto small = registry.Get(std::string(fontPath));
+	const auto large = registry.Get(std::string(fontPath));
+	small->SetSize(Trex::Pixels{ 12 });
+	large->SetSize(Trex::Pixels{ 48 });
+
+	Trex::Font own(fontPath.data());
+	own.SetSize(Trex::Pixels{ 48 });
+	EXPECT_EQ(large->GetMetrics().height, own.GetMetrics().height);
+	EXPECT_LT(small->GetMetrics().height, large->GetMetrics().height);
+}
+
+TEST(FontRegistryTests, atlasesSharingFaceShouldMatchAtlasesWithOwnFont)
+{
+	Trex::FontRegistry registry;
+	const Trex::AtlasOptions dynamic{ .atlasMode = Trex::AtlasMode::DYNAMIC };
+	Trex::Atlas small(registry.Get(std::string(fontPath)), 16, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	Trex::Atlas large(registry.Get(std::string(fontPath)), 48, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	EXPECT_EQ(small.GetFont()->face, large.GetFont()->face);
+
+	// Glyphs are added alternately, so each atlas has to activate its own size first
+	Trex::Atlas ownSmall(std::make_shared<Trex::Font>(fontPath.data()), 16, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	Trex::Atlas ownLarge(std::make_shared<Trex::Font>(fontPath.data()), 48, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	for (uint32_t codepoint : { 0x105, 0x107, 0x119 })
+	{
+		EXPECT_EQ(small.LoadGlyphByCodepoint(codepoint).height, ownSmall.LoadGlyphByCodepoint(codepoint).height);
+		EXPECT_EQ(large.LoadGlyphByCodepoint(codepoint).height, ownLarge.LoadGlyphByCodepoint(codepoint).height);
+	}
+	EXPECT_EQ(small.GetBitmap().Data(), ownSmall.GetBitmap().Data());
+	EXPECT_EQ(large.GetBitmap().Data(), ownLarge.GetBitmap().Data());
+}
+
+TEST(FontThreadingTests, atlasesSharingFaceShouldBeBuildableOnManyThreads)
+{
+	constexpr int sizes[] = { 12, 16, 24, 32, 48, 64 };
+	Trex::FontRegistry registry;
+	std::vector<std::vector<uint8_t>> serialBitmaps;
+	for (int size : sizes)
+	{
+		serialBitmaps.push_back(Trex::Atlas(registry.Get(std::string(fontPath)), size).GetBitmap().Data());
+	}
+
+	std::vector<std::vector<uint8_t>> parallelBitmaps(std::size(sizes));
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < std::size(sizes); ++i)
+	{
+		threads.emplace_back([&, i] {
+			parallelBitmaps[i] = Trex::Atlas(registry.Get(std::string(fontPath)), sizes[i]).GetBitmap().Data();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	EXPECT_EQ(parallelBitmaps, serialBitmaps);
+}
+
+TEST(FontThreadingTests, dynamicAtlasesSharingFaceShouldAddGlyphsOnManyThreads)
+{
+	const Trex::AtlasOptions dynamic{ .atlasMode = Trex::AtlasMode::DYNAMIC };
+	Trex::FontRegistry registry;
+	Trex::Atlas small(registry.Get(std::string(fontPath)), 16, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	Trex::Atlas large(registry.Get(std::string(fontPath)), 48, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	Trex::Atlas ownSmall(std::make_shared<Trex::Font>(fontPath.data()), 16, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+	Trex::Atlas ownLarge(std::make_shared<Trex::Font>(fontPath.data()), 48, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, dynamic);
+
+	const auto addGlyphs = [](Trex::Atlas& atlas) {
+		for (uint32_t codepoint = 0x100; codepoint < 0x180; ++codepoint)
+		{
+			atlas.LoadGlyphByCodepoint(codepoint);
+		}
+	};
+	std::thread smallThread(addGlyphs, std::ref(small));
+	std::thread largeThread(addGlyphs, std::ref(large));
+	addGlyphs(ownSmall);
+	addGlyphs(ownLarge);
+	smallThread.join();
+	largeThread.join();
+
+	EXPECT_EQ(small.GetBitmap().Data(), ownSmall.GetBitmap().Data());
+	EXPECT_EQ(large.GetBitmap().Data(), ownLarge.GetBitmap().Data());
+}
+
+class FontCollectionTests : public Test
+{
+protected:
+	const std::vector<uint8_t> collection = BuildFontCollection({ ReadFontFile(), ReadFontFile("fonts/OpenMoji.ttf") });
+};
+
+TEST_F(FontCollectionTests, fontShouldSelectFaceOfCollection)
+{
+	const Trex::Font first(collection, Trex::DataOwnership::BORROW, 0);
+	const Trex::Font second(collection, Trex::DataOwnership::BORROW, 1);
+	EXPECT_EQ(first.GetFaceCount(), 2);
+	EXPECT_EQ(first.GetFaceIndex(), 0);
+	EXPECT_EQ(second.GetFaceIndex(), 1);
+	EXPECT_EQ(first.GetFamilyName(), Trex::Font(fontPath.data()).GetFamilyName());
+	EXPECT_EQ(second.GetFamilyName(), Trex::Font("fonts/OpenMoji.ttf").GetFamilyName());
+	EXPECT_NE(first.GetContentHash(), second.GetContentHash());
+}
+
+TEST_F(FontCollectionTests, shouldThrowWhenFaceIndexIsOutOfRange)
+{
+	EXPECT_THROW(Trex::Font(collection, Trex::DataOwnership::BORROW, 2), std::runtime_error);
+	EXPECT_THROW(Trex::Font(fontPath.data(), 1), std::runtime_error);
+}
+
+TEST_F(FontCollectionTests, facesOfCollectionShouldShareData)
+{
+	const std::string path = "FontCollectionTests.ttc";
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(collection.data()), static_cast<std::streamsize>(collection.size()));
+	}
+
+	Trex::FontRegistry registry;
+	const auto faces = registry.GetAllFaces(path);
+	ASSERT_EQ(faces.size(), 2);
+	EXPECT_EQ(registry.FaceCount(), 2);
+	EXPECT_NE(faces[0]->face, faces[1]->face);
+	EXPECT_EQ(faces[0]->face->stream->base, faces[1]->face->stream->base);
+	EXPECT_EQ(faces[1]->GetFaceIndex(), 1);
+
+	const auto copies = { registry.Get(collection, 0), registry.Get(collection, 1) };
+	EXPECT_EQ(copies.begin()[0]->face->stream->base, copies.begin()[1]->face->stream->base);
+	EXPECT_NE(copies.begin()[0]->face->stream->base, collection.data());
+	std::filesystem::remove(path);
+}
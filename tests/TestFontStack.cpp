@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include "Trex/FontStack.hpp"
+#include "Trex/FontRegistry.hpp"
+#include "Trex/Atlas.hpp"
+
+using namespace testing;
+constexpr std::string_view fontPath = "fonts/Roboto-Regular.ttf";
+constexpr std::string_view emojiFontPath = "fonts/OpenMoji.ttf";
+constexpr uint32_t emojiCodepoint = 0x1F600; // Grinning face
+
+class FontStackTests : public Test
+{
+protected:
+	Trex::FontRegistry registry;
+	std::shared_ptr<Trex::Font> text = registry.Get(std::string(fontPath));
+	std::shared_ptr<Trex::Font> emoji = registry.Get(std::string(emojiFontPath));
+	Trex::FontStack fonts{ { text, emoji } };
+};
+
+TEST_F(FontStackTests, shouldResolveCodepointToFirstFontHavingIt)
+{
+	EXPECT_EQ(fonts.ResolveCodepoint('A'), 0);
+	EXPECT_EQ(fonts.ResolveCodepoint(emojiCodepoint), 1);
+}
+
+TEST_F(FontStackTests, shouldResolveMissingCodepointToPrimaryFont)
+{
+	EXPECT_EQ(fonts.ResolveCodepoint(0x10FFFD), 0);
+	EXPECT_EQ(fonts.ResolveCodepoint(0xFFFFFFFF), 0);
+	EXPECT_EQ(fonts.GetGlyphIndex(0x10FFFD), 0);
+}
+
+TEST_F(FontStackTests, primaryFontShouldWinWhenBothFontsHaveCodepoint)
+{
+	ASSERT_NE(emoji->GetGlyphIndex('0'), 0);
+	ASSERT_NE(text->GetGlyphIndex('0'), 0);
+	EXPECT_EQ(fonts.ResolveCodepoint('0'), 0);
+	EXPECT_EQ(Trex::FontStack({ emoji, text }).ResolveCodepoint('0'), 0);
+	EXPECT_EQ(Trex::FontStack({ emoji, text }).ResolveCodepoint('A'), 1);
+}
+
+TEST_F(FontStackTests, glyphIndicesOfFallbackFontsShouldFollowPreviousFonts)
+{
+	const uint32_t textGlyphCount = fonts.GetGlyphOffset(1);
+	EXPECT_EQ(fonts.GetGlyphOffset(0), 0);
+	EXPECT_EQ(fonts.GetGlyphIndex('A'), text->GetGlyphIndex('A'));
+	EXPECT_EQ(fonts.GetGlyphIndex(emojiCodepoint), textGlyphCount + emoji->GetGlyphIndex(emojiCodepoint));
+	EXPECT_EQ(fonts.GetFontOfGlyph(textGlyphCount - 1), 0);
+	EXPECT_EQ(fonts.GetFontOfGlyph(textGlyphCount), 1);
+	EXPECT_EQ(fonts.GetFontOfGlyph(fonts.GlyphCount() - 1), 1);
+}
+
+TEST_F(FontStackTests, shouldThrowWhenStackIsEmpty)
+{
+	EXPECT_THROW(Trex::FontStack(std::vector<std::shared_ptr<Trex::Font>>{}), std::runtime_error);
+}
+
+TEST_F(FontStackTests, atlasShouldContainGlyphsOfAllFonts)
+{
+	const Trex::Charset charset = Trex::Charset::Ascii().Union(Trex::Charset(0x1F600, 0x1F64F));
+	Trex::Atlas atlas(fonts, 32, charset, Trex::RenderMode::COLOR);
+
+	const Trex::Glyph& letter = atlas.GetGlyphs().GetGlyphByCodepoint('A');
+	const Trex::Glyph& face = atlas.GetGlyphs().GetGlyphByCodepoint(emojiCodepoint);
+	EXPECT_EQ(letter.glyphIndex, text->GetGlyphIndex('A'));
+	EXPECT_EQ(face.glyphIndex, fonts.GetGlyphIndex(emojiCodepoint));
+	EXPECT_EQ(face.codepoint, emojiCodepoint);
+	EXPECT_GT(face.width, 0);
+	EXPECT_NE(face, atlas.GetGlyphs().GetUnknownGlyph());
+}
+
+TEST_F(FontStackTests, primaryFontGlyphsShouldNotChangeWithFallbackFonts)
+{
+	Trex::Atlas single(registry.Get(std::string(fontPath)), 32, Trex::Charset::Ascii());
+	Trex::Atlas stacked(fonts, 32, Trex::Charset::Ascii());
+	EXPECT_EQ(single.GetBitmap().Data(), stacked.GetBitmap().Data());
+	EXPECT_EQ(single.GetGlyphs().Size(), stacked.GetGlyphs().Size());
+}
+
+TEST_F(FontStackTests, dynamicAtlasShouldAddGlyphsOfFallbackFonts)
+{
+	const Trex::AtlasOptions dynamic{ .atlasMode = Trex::AtlasMode::DYNAMIC };
+	Trex::Atlas atlas(fonts, 32, Trex::Charset::Ascii(), Trex::RenderMode::COLOR, 1, dynamic);
+	ASSERT_FALSE(atlas.GetGlyphs().Contains(fonts.GetGlyphIndex(emojiCodepoint)));
+
+	const Trex::Glyph& byCodepoint = atlas.LoadGlyphByCodepoint(emojiCodepoint);
+	EXPECT_EQ(byCodepoint.glyphIndex, fonts.GetGlyphIndex(emojiCodepoint));
+	EXPECT_GT(byCodepoint.width, 0);
+
+	const uint32_t otherEmoji = fonts.GetGlyphIndex(0x1F601);
+	EXPECT_EQ(atlas.LoadGlyphByIndex(otherEmoji).glyphIndex, otherEmoji);
+}
+
+TEST_F(FontStackTests, parallelAtlasShouldBeIdenticalToSerialAtlas)
+{
+	const Trex::Charset charset = Trex::Charset::Ascii().Union(Trex::Charset(0x1F600, 0x1F64F));
+	Trex::Atlas serial(fonts, 24, charset, Trex::RenderMode::COLOR, 1, { .threads = 1 });
+	Trex::Atlas parallel(fonts, 24, charset, Trex::RenderMode::COLOR, 1, { .threads = 4 });
+	EXPECT_EQ(serial.GetBitmap().Data(), parallel.GetBitmap().Data());
+}
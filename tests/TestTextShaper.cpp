@@ -1,6 +1,9 @@
 
 #include <gtest/gtest.h>
+#include <chrono>
+#include <future>
 #include "Trex/TextShaper.hpp"
+#include "Trex/FontRegistry.hpp"
 
 using namespace testing;
 constexpr std::string_view fontPath = "fonts/Roboto-Regular.ttf";
@@ -60,3 +63,329 @@ TEST_F(TextShaperTests, shouldMeasureText)
 	EXPECT_NEAR(measurement.xAdvance, 178.5, 1.0);
 	EXPECT_FLOAT_EQ(measurement.yAdvance, 0.0f);
 }
+
+TEST_F(TextShaperTests, shouldAppendGlyphsToOutput)
+{
+	Trex::ShapedGlyphs output = shaper.ShapeAscii(std::string_view("Hello"));
+	shaper.ShapeUtf32(std::u32string_view(U", Świecie!"), output);
+	const Trex::ShapedGlyphs expected = shaper.ShapeUtf32(std::u32string_view(U"Hello, Świecie!"));
+
+	ASSERT_EQ(output.size(), expected.size());
+	for (size_t i = 0; i < output.size(); ++i)
+	{
+		EXPECT_EQ(output[i].info, expected[i].info);
+	}
+}
+
+TEST_F(TextShaperTests, shouldReuseOutputMemory)
+{
+	constexpr uint32_t unicodeText[] = { 'H', 'e', 'l', 'l', 'o', ' ', 0x15a, 'w', 'i', 'a', 't' };
+	Trex::ShapedGlyphs output;
+	output.reserve(std::size(unicodeText));
+	const Trex::ShapedGlyph* data = output.data();
+
+	for (Trex::ShapeCacheMode mode : { Trex::ShapeCacheMode::TEXT, Trex::ShapeCacheMode::WORDS })
+	{
+		shaper.SetCacheCapacity(0);
+		output.clear();
+		shaper.ShapeUnicode(unicodeText, output);
+		shaper.SetCacheCapacity(8, mode);
+		for (int frame = 0; frame < 3; ++frame)
+		{
+			output.clear();
+			shaper.ShapeUnicode(unicodeText, output);
+		}
+		EXPECT_EQ(output.size(), std::size(unicodeText));
+		EXPECT_EQ(output.data(), data);
+	}
+}
+
+TEST_F(TextShaperTests, shapedTextShouldMatchShapedGlyphs)
+{
+	const std::string text = "Hello, \xc5\x9awiecie! Hello?";
+	const Trex::ShapedGlyphs expected = shaper.ShapeUtf8(text);
+
+	for (const size_t capacity : { 0, 16 })
+	{
+		for (const Trex::ShapeCacheMode mode : { Trex::ShapeCacheMode::TEXT, Trex::ShapeCacheMode::WORDS })
+		{
+			shaper.SetCacheCapacity(capacity, mode);
+			Trex::ShapedText shaped;
+			shaper.ShapeUtf8(text, shaped);
+			shaper.ShapeUtf8(text, shaped); // Cache hit appended after the miss
+
+			ASSERT_EQ(shaped.Size(), expected.size() * 2);
+			for (size_t i = 0; i < shaped.Size(); ++i)
+			{
+				const Trex::ShapedGlyph& glyph = expected[i % expected.size()];
+				EXPECT_EQ(shaper.GetGlyph(shaped.glyphIndices[i]), glyph.info);
+				EXPECT_FLOAT_EQ(shaped.xOffsets[i], glyph.xOffset);
+				EXPECT_FLOAT_EQ(shaped.yOffsets[i], glyph.yOffset);
+				EXPECT_FLOAT_EQ(shaped.xAdvances[i], glyph.xAdvance);
+				EXPECT_FLOAT_EQ(shaped.yAdvances[i], glyph.yAdvance);
+			}
+		}
+	}
+}
+
+TEST_F(TextShaperTests, shouldMeasureShapedText)
+{
+	const std::string asciiText = "Hello, World!";
+	Trex::ShapedText shaped;
+	shaper.ShapeAscii(asciiText, shaped);
+
+	const Trex::TextMeasurement expected = Trex::TextShaper::Measure(shaper.ShapeAscii(asciiText));
+	const Trex::TextMeasurement measurement = shaper.Measure(shaped);
+	EXPECT_FLOAT_EQ(measurement.width, expected.width);
+	EXPECT_FLOAT_EQ(measurement.height, expected.height);
+	EXPECT_FLOAT_EQ(measurement.xOffset, expected.xOffset);
+	EXPECT_FLOAT_EQ(measurement.yOffset, expected.yOffset);
+	EXPECT_FLOAT_EQ(measurement.xAdvance, expected.xAdvance);
+	EXPECT_FLOAT_EQ(measurement.yAdvance, expected.yAdvance);
+
+	shaped.Clear();
+	EXPECT_TRUE(shaped.Empty());
+	EXPECT_FLOAT_EQ(shaper.Measure(shaped).width, 0.0f);
+}
+
+TEST_F(TextShaperTests, shouldMeasureTextAboveBaseline)
+{
+	const std::string quotes = "'\"'";
+	Trex::ShapedText shaped;
+	shaper.ShapeAscii(quotes, shaped);
+
+	const Trex::TextMeasurement expected = Trex::TextShaper::Measure(shaper.ShapeAscii(quotes));
+	const Trex::TextMeasurement measurement = shaper.Measure(shaped);
+	EXPECT_LT(expected.yOffset + expected.height, 0.0f); // Bottom of the quotes is above the baseline
+	EXPECT_FLOAT_EQ(measurement.height, expected.height);
+	EXPECT_FLOAT_EQ(measurement.yOffset, expected.yOffset);
+}
+
+TEST_F(TextShaperTests, shapersShouldShareGlyphTableOfAtlas)
+{
+	const Trex::TextShaper other(atlas);
+	const uint32_t glyphIndex = atlas.GetGlyphs().GetGlyphByCodepoint('A').glyphIndex;
+	EXPECT_EQ(&shaper.GetGlyph(glyphIndex), &atlas.GetGlyphs().GetGlyphByIndex(glyphIndex));
+	EXPECT_EQ(&other.GetGlyph(glyphIndex), &atlas.GetGlyphs().GetGlyphByIndex(glyphIndex));
+}
+
+TEST_F(TextShaperTests, shapersOnDifferentThreadsShouldNotWaitForSharedFace)
+{
+	const std::string text = "Hello, World!";
+	const Trex::ShapedGlyphs expected = shaper.ShapeUtf8(text);
+
+	std::vector<std::future<Trex::ShapedGlyphs>> results;
+	{
+		// Shapers use their own clones of the font, so the lock of the face held here does not stop them
+		const auto lock = atlas.GetFont()->LockFace();
+		for (int thread = 0; thread < 2; ++thread)
+		{
+			results.push_back(std::async(std::launch::async, [&] {
+				Trex::TextShaper threadShaper(atlas);
+				Trex::ShapedGlyphs glyphs;
+				for (int i = 0; i < 100; ++i)
+				{
+					glyphs = threadShaper.ShapeUtf8(text);
+				}
+				return glyphs;
+			}));
+		}
+		for (auto& result : results)
+		{
+			EXPECT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+		}
+	}
+
+	for (auto& result : results)
+	{
+		const Trex::ShapedGlyphs glyphs = result.get();
+		ASSERT_EQ(glyphs.size(), expected.size());
+		for (size_t i = 0; i < glyphs.size(); ++i)
+		{
+			EXPECT_EQ(glyphs[i].info, expected[i].info);
+			EXPECT_EQ(glyphs[i].xAdvance, expected[i].xAdvance);
+		}
+	}
+}
+
+TEST_F(TextShaperTests, shouldNotCacheByDefault)
+{
+	shaper.ShapeAscii(std::string_view("Hello"));
+	shaper.ShapeAscii(std::string_view("Hello"));
+	const Trex::ShapeCacheStats stats = shaper.GetCacheStats();
+	EXPECT_EQ(stats.hits, 0);
+	EXPECT_EQ(stats.misses, 0);
+	EXPECT_EQ(stats.size, 0);
+}
+
+TEST_F(TextShaperTests, cacheShouldReturnSameResultForSameText)
+{
+	shaper.SetCacheCapacity(8);
+	const Trex::SharedShapedGlyphs first = shaper.ShapeUtf8Shared(std::string_view("Hello"));
+	const Trex::SharedShapedGlyphs second = shaper.ShapeUtf8Shared(std::string_view("Hello"));
+	const Trex::ShapedGlyphs copy = shaper.ShapeAscii(std::string_view("Hello"));
+
+	EXPECT_EQ(first, second);
+	EXPECT_EQ(copy.size(), first->size());
+	EXPECT_EQ(copy.back().info, first->back().info);
+	EXPECT_EQ(shaper.GetCacheStats().hits, 2);
+	EXPECT_EQ(shaper.GetCacheStats().misses, 1);
+}
+
+TEST_F(TextShaperTests, cacheShouldKeepEncodingsApart)
+{
+	shaper.SetCacheCapacity(8);
+	constexpr uint32_t codepoints[] = { 'H', 'i' };
+	constexpr char utf8[] = { 'H', '\0', '\0', '\0', 'i', '\0', '\0', '\0' }; // Same bytes as the codepoints
+	const Trex::SharedShapedGlyphs unicode = shaper.ShapeUnicodeShared(codepoints);
+	const Trex::SharedShapedGlyphs bytes = shaper.ShapeUtf8Shared(utf8);
+
+	EXPECT_NE(unicode, bytes);
+	EXPECT_EQ(unicode->size(), 2);
+	EXPECT_EQ(shaper.GetCacheStats().misses, 2);
+}
+
+TEST_F(TextShaperTests, cacheShouldDropLeastRecentlyUsedText)
+{
+	shaper.SetCacheCapacity(2);
+	shaper.ShapeAscii(std::string_view("A"));
+	shaper.ShapeAscii(std::string_view("B"));
+	shaper.ShapeAscii(std::string_view("A"));
+	shaper.ShapeAscii(std::string_view("C")); // Drops "B"
+	EXPECT_EQ(shaper.GetCacheStats().size, 2);
+
+	shaper.ShapeAscii(std::string_view("A"));
+	EXPECT_EQ(shaper.GetCacheStats().hits, 2);
+	shaper.ShapeAscii(std::string_view("B"));
+	EXPECT_EQ(shaper.GetCacheStats().misses, 4);
+
+	shaper.SetCacheCapacity(1);
+	EXPECT_EQ(shaper.GetCacheStats().size, 1);
+	shaper.ClearCache();
+	EXPECT_EQ(shaper.GetCacheStats().size, 0);
+}
+
+TEST_F(TextShaperTests, wordCacheShouldShapeEveryWordOnce)
+{
+	shaper.SetCacheCapacity(8, Trex::ShapeCacheMode::WORDS);
+	const Trex::ShapedGlyphs glyphs = shaper.ShapeAscii(std::string_view("the cat  the cat"));
+
+	EXPECT_EQ(glyphs.size(), 16);
+	const Trex::ShapeCacheStats stats = shaper.GetCacheStats();
+	EXPECT_EQ(stats.misses, 4); // "the", " ", "cat", "  "
+	EXPECT_EQ(stats.hits, 3);
+	EXPECT_EQ(stats.size, 4);
+}
+
+TEST_F(TextShaperTests, wordCacheShouldMatchShapingWholeText)
+{
+	const std::u32string text = U" Zażółć gęślą jaźń, zażółć  jaźń! ";
+	const Trex::ShapedGlyphs expected = shaper.ShapeUtf32(text);
+
+	shaper.SetCacheCapacity(64, Trex::ShapeCacheMode::WORDS);
+	shaper.ShapeUtf32(text);
+	const Trex::ShapedGlyphs glyphs = shaper.ShapeUtf32(text);
+
+	ASSERT_EQ(glyphs.size(), expected.size());
+	for (size_t i = 0; i < glyphs.size(); ++i)
+	{
+		EXPECT_EQ(glyphs[i].info, expected[i].info);
+		EXPECT_FLOAT_EQ(glyphs[i].xAdvance, expected[i].xAdvance);
+		EXPECT_FLOAT_EQ(glyphs[i].xOffset, expected[i].xOffset);
+		EXPECT_FLOAT_EQ(glyphs[i].yOffset, expected[i].yOffset);
+	}
+	EXPECT_GT(shaper.GetCacheStats().hits, 0);
+}
+
+TEST_F(TextShaperTests, wordCacheShouldShapeWordStartingWithCombiningMarkInContext)
+{
+	// The acute accent is merged into the cluster of the space before it, so the word cannot be cut out of its padding
+	const std::u32string text = U"\u0301e b \u0301e";
+	const Trex::ShapedGlyphs expected = shaper.ShapeUtf32(text);
+
+	shaper.SetCacheCapacity(64, Trex::ShapeCacheMode::WORDS);
+	shaper.ShapeUtf32(text);
+	const Trex::ShapedGlyphs glyphs = shaper.ShapeUtf32(text);
+
+	ASSERT_EQ(glyphs.size(), expected.size());
+	for (size_t i = 0; i < glyphs.size(); ++i)
+	{
+		EXPECT_EQ(glyphs[i].info, expected[i].info);
+		EXPECT_FLOAT_EQ(glyphs[i].xAdvance, expected[i].xAdvance);
+		EXPECT_FLOAT_EQ(glyphs[i].xOffset, expected[i].xOffset);
+	}
+}
+
+TEST(DynamicTextShaperTests, shouldAddMissingGlyphsToDynamicAtlas)
+{
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, { .atlasMode = Trex::AtlasMode::DYNAMIC });
+	Trex::TextShaper shaper(atlas, Trex::TextShaper::LoadMissingGlyphs{});
+
+	constexpr char utf8Text[] = "\xc5\x9awiecie";
+	const Trex::ShapedGlyphs glyphs = shaper.ShapeUtf8(utf8Text);
+
+	ASSERT_FALSE(glyphs.empty());
+	EXPECT_NE(glyphs[0].info, atlas.GetGlyphs().GetUnknownGlyph());
+	EXPECT_EQ(glyphs[0].info, atlas.GetGlyphs().GetGlyphByCodepoint(0x15A));
+	EXPECT_FALSE(atlas.TakeDirtyRegions().empty());
+}
+
+TEST(DynamicTextShaperTests, shapedTextShouldReferToGlyphsAddedToAtlas)
+{
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, { .atlasMode = Trex::AtlasMode::DYNAMIC });
+	Trex::TextShaper shaper(atlas, Trex::TextShaper::LoadMissingGlyphs{});
+
+	Trex::ShapedText shaped;
+	shaper.ShapeUtf8(std::string_view("\xc5\x9awiecie"), shaped);
+
+	ASSERT_FALSE(shaped.Empty());
+	EXPECT_EQ(shaper.GetGlyph(shaped.glyphIndices[0]), atlas.GetGlyphs().GetGlyphByCodepoint(0x15A));
+	EXPECT_EQ(&shaper.GetGlyph(shaped.glyphIndices[0]), &atlas.GetGlyphs().GetGlyphByIndex(shaped.glyphIndices[0]));
+}
+
+TEST(DynamicTextShaperTests, shaperShouldKeepGlyphsFromItsCreationByDefault)
+{
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset::Ascii(), Trex::RenderMode::DEFAULT, 1, { .atlasMode = Trex::AtlasMode::DYNAMIC });
+	Trex::TextShaper shaper(atlas);
+	const Trex::Glyph glyph = atlas.LoadGlyphByCodepoint(0x15A);
+
+	EXPECT_EQ(shaper.ShapeUtf8(std::string_view("\xc5\x9a")).front().info, atlas.GetGlyphs().GetUnknownGlyph());
+	EXPECT_EQ(Trex::TextShaper(atlas).ShapeUtf8(std::string_view("\xc5\x9a")).front().info, glyph);
+}
+
+TEST(DynamicTextShaperTests, cachedTextShouldFollowEvictedGlyphs)
+{
+	const Trex::AtlasOptions options{ .atlasMode = Trex::AtlasMode::CACHE, .width = 64, .height = 64 };
+	Trex::Atlas atlas(fontPath.data(), 32, Trex::Charset(), Trex::RenderMode::DEFAULT, 1, options);
+	Trex::TextShaper shaper(atlas, Trex::TextShaper::LoadMissingGlyphs{});
+	shaper.SetCacheCapacity(8);
+
+	const Trex::SharedShapedGlyphs first = shaper.ShapeUtf8Shared(std::string_view("AB"));
+	shaper.ShapeAscii(std::string_view("WXYZ")); // Does not fit next to "AB", so its glyphs are evicted
+	const Trex::SharedShapedGlyphs second = shaper.ShapeUtf8Shared(std::string_view("AB"));
+
+	EXPECT_EQ(shaper.GetCacheStats().hits, 1);
+	ASSERT_EQ(second->size(), 2);
+	EXPECT_EQ((*second)[0].info, atlas.GetGlyphs().GetGlyphByCodepoint('A'));
+	EXPECT_EQ((*second)[1].info, atlas.GetGlyphs().GetGlyphByCodepoint('B'));
+	EXPECT_EQ(first->size(), 2); // The first result is not changed
+}
+
+TEST(FallbackTextShaperTests, shouldShapeEachCharacterWithFirstFontHavingIt)
+{
+	Trex::FontRegistry registry;
+	const Trex::FontStack fonts({ registry.Get(std::string(fontPath)), registry.Get("fonts/OpenMoji.ttf") });
+	const Trex::Charset charset = Trex::Charset::Ascii().Union(Trex::Charset(0x1F600, 0x1F64F));
+	const Trex::Atlas atlas(fonts, 32, charset, Trex::RenderMode::COLOR);
+	Trex::TextShaper shaper(atlas);
+
+	const std::u32string text = U"Hi \U0001F600!";
+	const Trex::ShapedGlyphs glyphs = shaper.ShapeUtf32(text);
+
+	ASSERT_EQ(glyphs.size(), text.size());
+	EXPECT_EQ(glyphs[0].info, atlas.GetGlyphs().GetGlyphByCodepoint('H'));
+	EXPECT_EQ(glyphs[3].info, atlas.GetGlyphs().GetGlyphByCodepoint(0x1F600));
+	EXPECT_EQ(glyphs[4].info, atlas.GetGlyphs().GetGlyphByCodepoint('!'));
+	EXPECT_GE(glyphs[3].info.glyphIndex, fonts.GetGlyphOffset(1));
+	EXPECT_GT(glyphs[3].xAdvance, 0.0f);
+}